@@ -11,6 +11,9 @@
 #include "opencv2/objdetect/objdetect.hpp"
 #include <opencv2/video/tracking.hpp>
 
+#include "Fonte_Quadros.hpp"
+#include "Registro_Cascatas.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -73,14 +76,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   Mat topLeftOfFace = face(Rect(leftX, topY, widthX, heightY));
   Mat topRightOfFace = face(Rect(rightX, topY, widthX, heightY));
 
-  CascadeClassifier haar_cascade;
-  haar_cascade.load(PATH_CASCADE_LEFTEYE);
+  // Loaded once per thread, see Registro_Cascatas.hpp
+  CascadeClassifier *haar_cascade = &cascade(PATH_CASCADE_LEFTEYE);
 
   vector< Rect_<int> > detectedRightEye;
   vector< Rect_<int> > detectedLeftEye;
   Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
   // Find the left eye:
-  haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+  haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
   for(int i = 0; i < detectedLeftEye.size(); i++) {
     Rect eye_i = detectedLeftEye[i];
     eye_i.x += leftX;
@@ -89,8 +92,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedLeftEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
     for(int i = 0; i < detectedLeftEye.size(); i++) {
       Rect eye_i = detectedLeftEye[i];
       eye_i.x += leftX;
@@ -99,8 +102,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
     }
   }
   //Find the right eye
-  haar_cascade.load(PATH_CASCADE_RIGHTEYE);
-  haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+  haar_cascade = &cascade(PATH_CASCADE_RIGHTEYE);
+  haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
   for(int i = 0; i < detectedRightEye.size(); i++) {
     Rect eye_i = detectedRightEye[i];
     eye_i.x += rightX;;
@@ -109,8 +112,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedRightEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
     for(int i = 0; i < detectedRightEye.size(); i++) {
       Rect eye_i = detectedRightEye[i];
       eye_i.x += leftX;
@@ -258,22 +261,6 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   return dstImg;
 }
 
-static void read_csv(const string& filename, vector<Mat>& images, char separator = ';') {
-    std::ifstream file(filename.c_str(), ifstream::in);
-    if (!file) {
-        string error_message = "No valid input file was given, please check the given filename.";
-        CV_Error(CV_StsBadArg, error_message);
-    }
-    string line, path, classlabel;
-    while (getline(file, line)) {
-        stringstream liness(line);
-        getline(liness, path, separator);
-        if(!path.empty()) {
-            images.push_back(imread(path, 0));
-        }
-    }
-}
-
 int main(int argc, char *argv[])
 {
 	//KALMAN
@@ -285,15 +272,14 @@ int main(int argc, char *argv[])
 	processNoise = Mat(4, 1, CV_32F);
 
     vector<Mat> images;
-    vector<Mat> video;
     vector<int> labels;
     Ptr<FaceRecognizer> model = createLBPHFaceRecognizer();
 
+    // Image list (CSV) or recording, streamed frame by frame
     string path = argv[1];
-    try {
-        read_csv(path, video);
-    } catch (cv::Exception& e) {
-        cerr << "Error opening file \"" << path << "\". Reason: " << e.msg << endl;
+    FrameSource *video = open_frame_source(path);
+    if(!video) {
+        cerr << "Error opening file \"" << path << "\"." << endl;
         exit(1);
     }
 
@@ -305,9 +291,10 @@ int main(int argc, char *argv[])
     vector<double> similaridades = vector<double>(5,0);
     double soma = 0;
     Point ultimaFace = Point(-1, -1);
-    for(int i = 0; i < video.size(); i++)
+    SourceFrame input;
+    while(video->read(input))
     {
-    	Mat frame = video[i];
+    	Mat frame = input.image;
         vector< Rect_<int> > faces;
         // Find the faces in the frame:
         haar_cascade.detectMultiScale(frame, faces);
@@ -363,5 +350,6 @@ int main(int argc, char *argv[])
 		    }
         }
     }
+    delete video;
     return 0;
 }
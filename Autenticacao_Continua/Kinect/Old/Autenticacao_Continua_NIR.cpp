@@ -29,6 +29,9 @@
 #include <fstream>
 #include <sstream>
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 
 #include <libfreenect2/libfreenect2.hpp>
@@ -42,6 +45,11 @@
 #include "opencv2/objdetect/objdetect.hpp"
 #include <opencv2/video/tracking.hpp>
 
+#define FRAME_SOURCE_KINECT
+#include "Fonte_Quadros.hpp"
+#include "Registro_Cascatas.hpp"
+#include "Medicao_Latencia.hpp"
+
  const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -69,23 +77,26 @@ const string PATH_CASCADE_RIGHTEYE = "/home/matheusm/libfreenect2/examples/proto
 const string PATH_CASCADE_LEFTEYE = "/home/matheusm/libfreenect2/examples/protonect/Cascades/haarcascade_mcs_lefteye_alt.xml";
 const string PATH_CASCADE_BOTHEYES = "/home/matheusm/libfreenect2/examples/protonect/Cascades/haarcascade_eye.xml";
 
-bool protonect_shutdown = false;
+volatile bool protonect_shutdown = false;
 
 void sigint_handler(int s)
 {
 	protonect_shutdown = true;
 }
 
-int framesLost = 0;
-KalmanFilter KFrightEye, KFleftEye;
-Mat_<float> state; /* (x, y, Vx, Vy) */
-Mat processNoise;
-Mat_<float> measurement;
-bool initiKalmanFilter = true;
-Point leftEyePredict = Point(-1,-1);
-Point rightEyePredict = Point(-1,-1);
+// Eye tracking state of one pipeline (Kalman filters that bridge frames where an eye is lost)
+struct EyeTracker {
+	int framesLost;
+	KalmanFilter KFrightEye, KFleftEye;
+	Mat_<float> measurement;
+	bool initiKalmanFilter;
+	Point leftEyePredict, rightEyePredict;
+
+	EyeTracker() : framesLost(0), KFrightEye(4, 2, 0), KFleftEye(4, 2, 0), measurement(Mat_<float>::zeros(2, 1)),
+		initiKalmanFilter(true), leftEyePredict(-1, -1), rightEyePredict(-1, -1) {}
+};
 
-Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
+Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess, EyeTracker &eyes) {
 	int im_height = face.rows;
 	Mat faceProcessed;
 
@@ -105,14 +116,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 	Mat topLeftOfFace = face(Rect(leftX, topY, widthX, heightY));
 	Mat topRightOfFace = face(Rect(rightX, topY, widthX, heightY));
 
-	CascadeClassifier haar_cascade;
-	haar_cascade.load(PATH_CASCADE_LEFTEYE);
+	// Loaded once per thread, see Registro_Cascatas.hpp
+	CascadeClassifier *haar_cascade = &cascade(PATH_CASCADE_LEFTEYE);
 
 	vector< Rect_<int> > detectedRightEye;
 	vector< Rect_<int> > detectedLeftEye;
 	Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
 	// Find the left eye:
-	haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+	haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
 	for(int i = 0; i < detectedLeftEye.size(); i++) {
 		Rect eye_i = detectedLeftEye[i];
 		eye_i.x += leftX;
@@ -121,8 +132,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 	}
 	// If cascade fails, try another
 	if(detectedLeftEye.empty()) {
-		haar_cascade.load(PATH_CASCADE_BOTHEYES);
-		haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+		haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+		haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
 		for(int i = 0; i < detectedLeftEye.size(); i++) {
 			Rect eye_i = detectedLeftEye[i];
 			eye_i.x += leftX;
@@ -131,8 +142,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 		}
 	}
 	//	Find the right eye
-	haar_cascade.load(PATH_CASCADE_RIGHTEYE);
-	haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+	haar_cascade = &cascade(PATH_CASCADE_RIGHTEYE);
+	haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
 	for(int i = 0; i < detectedRightEye.size(); i++) {
 		Rect eye_i = detectedRightEye[i];
 		eye_i.x += rightX;;
@@ -141,8 +152,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 	}
 	// If cascade fails, try another
 	if(detectedRightEye.empty()) {
-		haar_cascade.load(PATH_CASCADE_BOTHEYES);
-		haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+		haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+		haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
 		for(int i = 0; i < detectedRightEye.size(); i++) {
 			Rect eye_i = detectedRightEye[i];
 			eye_i.x += leftX;
@@ -151,58 +162,58 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 		}
 	}
 	//	Inicializacao dos kalman filters
-	if(initiKalmanFilter && leftEye.x >= 0 && rightEye.x >= 0) {
-		KFrightEye.statePre.at<float>(0) = rightEye.x;
-		KFrightEye.statePre.at<float>(1) = rightEye.y;
-		KFrightEye.statePre.at<float>(2) = 0;
-		KFrightEye.statePre.at<float>(3) = 0;
-		KFrightEye.transitionMatrix = *(Mat_<float>(4, 4) << 1,0,0,0,   0,1,0,0,  0,0,1,0,  0,0,0,1);
-		setIdentity(KFrightEye.measurementMatrix);
-		setIdentity(KFrightEye.processNoiseCov, Scalar::all(1e-4));
-		setIdentity(KFrightEye.measurementNoiseCov, Scalar::all(1e-1));
-		setIdentity(KFrightEye.errorCovPost, Scalar::all(.1));
-
-		KFleftEye.statePre.at<float>(0) = leftEye.x;
-		KFleftEye.statePre.at<float>(1) = leftEye.y;
-		KFleftEye.statePre.at<float>(2) = 0;
-		KFleftEye.statePre.at<float>(3) = 0;
-		KFleftEye.transitionMatrix = *(Mat_<float>(4, 4) << 1,0,0,0,   0,1,0,0,  0,0,1,0,  0,0,0,1);
-		setIdentity(KFleftEye.measurementMatrix);
-		setIdentity(KFleftEye.processNoiseCov, Scalar::all(1e-4));
-		setIdentity(KFleftEye.measurementNoiseCov, Scalar::all(1e-1));
-		setIdentity(KFleftEye.errorCovPost, Scalar::all(.1));
-		initiKalmanFilter = false;
+	if(eyes.initiKalmanFilter && leftEye.x >= 0 && rightEye.x >= 0) {
+		eyes.KFrightEye.statePre.at<float>(0) = rightEye.x;
+		eyes.KFrightEye.statePre.at<float>(1) = rightEye.y;
+		eyes.KFrightEye.statePre.at<float>(2) = 0;
+		eyes.KFrightEye.statePre.at<float>(3) = 0;
+		eyes.KFrightEye.transitionMatrix = *(Mat_<float>(4, 4) << 1,0,0,0,   0,1,0,0,  0,0,1,0,  0,0,0,1);
+		setIdentity(eyes.KFrightEye.measurementMatrix);
+		setIdentity(eyes.KFrightEye.processNoiseCov, Scalar::all(1e-4));
+		setIdentity(eyes.KFrightEye.measurementNoiseCov, Scalar::all(1e-1));
+		setIdentity(eyes.KFrightEye.errorCovPost, Scalar::all(.1));
+
+		eyes.KFleftEye.statePre.at<float>(0) = leftEye.x;
+		eyes.KFleftEye.statePre.at<float>(1) = leftEye.y;
+		eyes.KFleftEye.statePre.at<float>(2) = 0;
+		eyes.KFleftEye.statePre.at<float>(3) = 0;
+		eyes.KFleftEye.transitionMatrix = *(Mat_<float>(4, 4) << 1,0,0,0,   0,1,0,0,  0,0,1,0,  0,0,0,1);
+		setIdentity(eyes.KFleftEye.measurementMatrix);
+		setIdentity(eyes.KFleftEye.processNoiseCov, Scalar::all(1e-4));
+		setIdentity(eyes.KFleftEye.measurementNoiseCov, Scalar::all(1e-1));
+		setIdentity(eyes.KFleftEye.errorCovPost, Scalar::all(.1));
+		eyes.initiKalmanFilter = false;
 	}
 	//	Predicao e correcao dos kalman filter
-	if(!initiKalmanFilter && leftEye.x >= 0) {
-		Mat prediction = KFleftEye.predict();
+	if(!eyes.initiKalmanFilter && leftEye.x >= 0) {
+		Mat prediction = eyes.KFleftEye.predict();
 		Point predictPt(prediction.at<float>(0),prediction.at<float>(1));
-		measurement(0) = leftEye.x;
-		measurement(1) = leftEye.y;
+		eyes.measurement(0) = leftEye.x;
+		eyes.measurement(1) = leftEye.y;
 
-		Point measPt(measurement(0),measurement(1));
-		Mat estimated = KFleftEye.correct(measurement);
+		Point measPt(eyes.measurement(0),eyes.measurement(1));
+		Mat estimated = eyes.KFleftEye.correct(eyes.measurement);
 		Point statePt(estimated.at<float>(0),estimated.at<float>(1));
-		leftEyePredict.x = statePt.x;
-		leftEyePredict.y = statePt.y;
+		eyes.leftEyePredict.x = statePt.x;
+		eyes.leftEyePredict.y = statePt.y;
 	}
-	if(!initiKalmanFilter && rightEye.x >= 0) {
-		Mat prediction = KFrightEye.predict();
+	if(!eyes.initiKalmanFilter && rightEye.x >= 0) {
+		Mat prediction = eyes.KFrightEye.predict();
 		Point predictPt(prediction.at<float>(0),prediction.at<float>(1));
-		measurement(0) = rightEye.x;
-		measurement(1) = rightEye.y;
+		eyes.measurement(0) = rightEye.x;
+		eyes.measurement(1) = rightEye.y;
 
-		Point measPt(measurement(0),measurement(1));
-		Mat estimated = KFrightEye.correct(measurement);
+		Point measPt(eyes.measurement(0),eyes.measurement(1));
+		Mat estimated = eyes.KFrightEye.correct(eyes.measurement);
 		Point statePt(estimated.at<float>(0),estimated.at<float>(1));
-		rightEyePredict.x = statePt.x;
-		rightEyePredict.y = statePt.y;
+		eyes.rightEyePredict.x = statePt.x;
+		eyes.rightEyePredict.y = statePt.y;
 	}
 	//if both eyes were detected
 	Mat warped;
 	if (leftEye.x >= 0 && rightEye.x >= 0 && ((rightEye.x - leftEye.x) > (face.cols/4))) {
 		sucess = true;
-		framesLost = 0;
+		eyes.framesLost = 0;
 		int desiredFaceHeight = desiredFaceWidth;
 		// Get the center between the 2 eyes.
 		Point2f eyesCenter = Point2f( (leftEye.x + rightEye.x) * 0.5f, (leftEye.y + rightEye.y) * 0.5f );
@@ -228,15 +239,15 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
 		equalizeHist(warped, warped);
 		}
 	else {
-		framesLost++;
-		if(framesLost < MAX_FRAME_LOST && (leftEyePredict.x >= 0 || rightEyePredict.x >= 0)) {
+		eyes.framesLost++;
+		if(eyes.framesLost < MAX_FRAME_LOST && (eyes.leftEyePredict.x >= 0 || eyes.rightEyePredict.x >= 0)) {
 			if(leftEye.x < 0) {
-				leftEye.x = leftEyePredict.x;
-				leftEye.y = leftEyePredict.y;
+				leftEye.x = eyes.leftEyePredict.x;
+				leftEye.y = eyes.leftEyePredict.y;
 			}
 			if(rightEye.x < 0) {
-				rightEye.x = rightEyePredict.x;
-				rightEye.y = rightEyePredict.y;
+				rightEye.x = eyes.rightEyePredict.x;
+				rightEye.y = eyes.rightEyePredict.y;
 			}
 			if((rightEye.x - leftEye.x) > (face.cols/4)) {
 				sucess = true;
@@ -305,46 +316,39 @@ static void read_csv(const string& filename, vector<Mat>& images, vector<int>& l
 	}
 }
 
-int main(int argc, char *argv[])
+// One source processed end to end (detection, login and continuous authentication) on its own thread
+struct Pipeline {
+	std::string spec;
+	FrameSource *source;
+	int cpu;                      // Core the processing thread is pinned to
+	bool gui;
+	pthread_t thread;
+	pthread_mutex_t mutex;        // Guards display and updated
+	Mat display;                  // Latest annotated frame, shown by the main thread
+	bool updated;
+	volatile bool finished;
+	int frames;
+	double seconds;
+	LatencyStats latency;         // Read by the main thread once finished
+};
+
+static void *run_pipeline(void *data)
 {
-	//KALMAN
-	measurement.setTo(Scalar(0));
-	measurement = Mat_<float>(2,1); 
-	KFrightEye = KalmanFilter(4, 2, 0);
-	KFleftEye = KalmanFilter(4, 2, 0);
-	state = Mat_<float>(4, 1); 
-	processNoise = Mat(4, 1, CV_32F);
+	Pipeline *pipeline = (Pipeline *) data;
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(pipeline->cpu, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
 	// Reconhecimento continuo
 	float P_Safe_Ultimo = 1.0, P_notSafe_Ultimo = 0.0;
 	float P_Atual_Safe, P_Atual_notSafe;
-	float P_Safe_Atual, P_notSafe_Atual;
-	float P_Safe;
+	float P_Safe_Atual = 0.0, P_notSafe_Atual = 0.0;
+	float P_Safe = 0.0;
 	float timeLastObs = 0, timeAtualObs = 0, tempo = 0;
 
-	std::string program_path(argv[0]);
-	size_t executable_name_idx = program_path.rfind("Protonect");
-	std::string binpath = "/";
-	if(executable_name_idx != std::string::npos)
-	{
-		binpath = program_path.substr(0, executable_name_idx);
-	}
-	libfreenect2::Freenect2 freenect2;
-	libfreenect2::Freenect2Device *dev = freenect2.openDefaultDevice();
-	if(dev == 0)
-	{
-		std::cout << "no device connected or failure opening the default one!" << std::endl;
-		return -1;
-	}
-	signal(SIGINT,sigint_handler);
-	protonect_shutdown = false;
-	libfreenect2::SyncMultiFrameListener listener(libfreenect2::Frame::Color | libfreenect2::Frame::Ir | libfreenect2::Frame::Depth);
-	libfreenect2::FrameMap frames;
-	dev->setColorFrameListener(&listener);
-	dev->setIrAndDepthFrameListener(&listener);
-	dev->start();
-	std::cout << "device serial: " << dev->getSerialNumber() << std::endl;
-	std::cout << "device firmware: " << dev->getFirmwareVersion() << std::endl;
-
+	EyeTracker eyes;
 	vector<Mat> images;
 	vector<int> labels;
     Ptr<FaceRecognizer> model = createLBPHFaceRecognizer();
@@ -353,21 +357,39 @@ int main(int argc, char *argv[])
     haar_cascade.load(PATH_CASCADE_FACE);
     bool sucess = false;
     int login = 0;
-    while(!protonect_shutdown)
+    int frames = 0;
+    int64 begin = getTickCount();
+    SourceFrame input;
+    Mat frame, shown;
+
+    // Every frame is timed from its arrival on the host to the P_Safe update it leads to
+    LatencyStats &latency = pipeline->latency;
+    int stage_detection = latency.stage("detection");
+    int stage_normalization = latency.stage("normalization");
+    int stage_prediction = latency.stage("prediction");
+    int stage_update = latency.stage("P_Safe update");
+    int64 t, decided = 0;
+    bool observed;
+    while(!protonect_shutdown && pipeline->source->read(input))
     {
-    	listener.waitForNewFrame(frames);
-    	libfreenect2::Frame *ir = frames[libfreenect2::Frame::Ir];
-    	Mat frame = cv::Mat(ir->height, ir->width, CV_32FC1, ir->data)/ 80000;
-    	frame.convertTo(frame, CV_8UC3, 255, 0);
+    	t = source_clock();
+    	latency.begin(input.sequence, input.timestamp, input.acquired, t, pipeline->source->clock() == RECORD_CLOCK_SENSOR);
+    	observed = false;
+    	input.image.copyTo(frame);
     	vector< Rect_<int> > faces;
     	// Find the faces in the frame:
     	haar_cascade.detectMultiScale(frame, faces);
+    	latency.add(stage_detection, source_clock()-t);
 
-    	tempo = getTickCount();
+    	// Frame time, so replays decay the probability as the live session did
+    	tempo = input.timestamp*getTickFrequency()/1000000.0;
+    	frames++;
     	for(int i = 0; i < faces.size(); i++) {
     		Mat face = frame(faces[i]);
     		Rect face_i = faces[i];
-    		Mat faceNormalized = faceNormalize(face, FACE_SIZE, sucess);
+    		t = source_clock();
+    		Mat faceNormalized = faceNormalize(face, FACE_SIZE, sucess, eyes);
+    		latency.add(stage_normalization, source_clock()-t);
     		rectangle(frame, face_i, CV_RGB(0, 0, 255), 1);
     		if(sucess) {
     			if(login < FRAMES_LOGIN) {
@@ -382,7 +404,9 @@ int main(int argc, char *argv[])
     				timeAtualObs = tempo;
     				double confidence;
     				int prediction;
+    				t = source_clock();
     				model->predict(faceNormalized, prediction, confidence);
+    				latency.add(stage_prediction, source_clock()-t);
     				Mat srcBGR = faceNormalized;
     				cv::resize(srcBGR, srcBGR, Size(100, 100), 1.0, 1.0, INTER_CUBIC);
     				int cx = (frame.cols - srcBGR.cols) - BORDER;
@@ -398,6 +422,7 @@ int main(int argc, char *argv[])
     				int pos_y = std::max(face_i.tl().y - 10, 0);
     				putText(frame, box_text, Point(face_i.x - box_text.size() + 10, face_i.y - 5), FONT_HERSHEY_PLAIN, 0.8, CV_RGB(255,255,255), 1.0);
                 	//reconhecimento continuo
+    				t = source_clock();
     				if(timeLastObs == 0) {
     					P_Atual_Safe = 1 - ((1 + erf((confidence-Usafe) / (Rsafe*sqrt(2))))/2);
     					P_Atual_notSafe = ((1 + erf((confidence-UnotSafe) / (RnotSafe*sqrt(2))))/2);
@@ -416,6 +441,8 @@ int main(int argc, char *argv[])
     					P_Safe_Atual = P_Atual_Safe + pow(E,elevado) * P_Safe_Ultimo;
     					P_notSafe_Atual = P_Atual_notSafe + pow(E,elevado) * P_notSafe_Ultimo;
     				}
+    				latency.add(stage_update, source_clock()-t);
+    				observed = true;
     			}
     		}
     	}
@@ -424,23 +451,133 @@ int main(int argc, char *argv[])
     		float elevado = (deltaT * LN2)/K_DROP;
     		P_Safe = (pow(E,elevado) * P_Safe_Atual)/(P_Safe_Atual+P_notSafe_Atual);
     	}
+    	if(observed) {
+    		latency.end(source_clock());
+    		decided = input.acquired;
+    	}
 
     	if(login == FRAMES_LOGIN) {
-    		string pSafe = format("Probability System Safe = %f", P_Safe);
+    		// Age of the newest frame behind P_Safe
+    		string pSafe = format("Probability System Safe = %f (%d ms)", P_Safe, decided ? (int) ((source_clock()-decided)/1000) : 0);
     		putText(frame, pSafe, Point(BORDER, frame.rows - BORDER), FONT_HERSHEY_PLAIN, 0.8, CV_RGB(255,255,255), 1.0);
     	}
     	else {
     		putText(frame, "Login in process...", Point(BORDER, frame.rows - BORDER), FONT_HERSHEY_PLAIN, 0.8, CV_RGB(255,255,255), 1.0);
     	}
-    	cv::resize(frame, frame, Size(frame.cols*1.5, frame.rows*1.5), 1.0, 1.0, INTER_CUBIC);
-    	cv::imshow("Infrared Face Recognition", frame);
-    	int key = cv::waitKey(1);
-	    protonect_shutdown = protonect_shutdown || (key > 0 && ((key & 0xFF) == 27)); // shutdown on escape
-	    listener.release(frames);
+    	if(!pipeline->gui)
+    		continue;
+    	cv::resize(frame, shown, Size(frame.cols*1.5, frame.rows*1.5), 1.0, 1.0, INTER_CUBIC);
+    	pthread_mutex_lock(&pipeline->mutex);
+    	shown.copyTo(pipeline->display);
+    	pipeline->updated = true;
+    	pthread_mutex_unlock(&pipeline->mutex);
     }
 
-    dev->stop();
-    dev->close();
 
-    return 0;
+    pipeline->frames = frames;
+    pipeline->seconds = (getTickCount()-begin)/getTickFrequency();
+    pipeline->finished = true;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string program_path(argv[0]);
+	size_t executable_name_idx = program_path.rfind("Protonect");
+	std::string binpath = "/";
+	if(executable_name_idx != std::string::npos)
+	{
+		binpath = program_path.substr(0, executable_name_idx);
+	}
+	// Sources: kinect[:serial] (default), "all" (every connected sensor), .rec recordings or image lists;
+	// each source gets its own pipeline. Recordings and lists replay at their pace unless "fast",
+	// "nogui" skips the display
+	vector<std::string> specs;
+	bool fast = false, gui = true;
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		if(arg == "fast")
+			fast = true;
+		else if(arg == "nogui")
+			gui = false;
+		else if(arg == "all")
+		{
+			vector<std::string> serials = kinect_serials();
+			for(size_t j = 0; j < serials.size(); j++)
+				specs.push_back("kinect:" + serials[j]);
+		}
+		else
+			specs.push_back(arg);
+	}
+	if(specs.empty())
+		specs.push_back("kinect");
+
+	// Sources are opened here, devices must not be opened concurrently
+	vector<Pipeline> pipelines(specs.size());
+	int cpus = std::max((int) sysconf(_SC_NPROCESSORS_ONLN), 1);
+	for(size_t i = 0; i < pipelines.size(); i++)
+	{
+		Pipeline &pipeline = pipelines[i];
+		pipeline.spec = specs[i];
+		pipeline.source = open_frame_source(specs[i]);
+		if(pipeline.source == 0)
+		{
+			std::cout << "could not open " << specs[i] << std::endl;
+			for(size_t j = 0; j < i; j++)
+				delete pipelines[j].source;
+			return -1;
+		}
+		pipeline.source->set_paced(!fast);
+		pipeline.cpu = i % cpus;
+		pipeline.gui = gui;
+		pipeline.updated = false;
+		pipeline.finished = false;
+		pipeline.frames = 0;
+		pipeline.seconds = 0.0;
+		pthread_mutex_init(&pipeline.mutex, NULL);
+	}
+	signal(SIGINT,sigint_handler);
+	protonect_shutdown = false;
+
+	for(size_t i = 0; i < pipelines.size(); i++)
+		pthread_create(&pipelines[i].thread, NULL, run_pipeline, &pipelines[i]);
+
+	// The main thread only displays (HighGUI is not thread safe)
+	while(!protonect_shutdown)
+	{
+		bool running = false;
+		for(size_t i = 0; i < pipelines.size(); i++)
+		{
+			running = running || !pipelines[i].finished;
+			if(!gui)
+				continue;
+			pthread_mutex_lock(&pipelines[i].mutex);
+			if(pipelines[i].updated)
+				cv::imshow(pipelines.size() > 1 ? "Infrared Face Recognition - " + pipelines[i].spec : "Infrared Face Recognition", pipelines[i].display);
+			pipelines[i].updated = false;
+			pthread_mutex_unlock(&pipelines[i].mutex);
+		}
+		if(!running)
+			break;
+		if(gui)
+		{
+			int key = cv::waitKey(1);
+			protonect_shutdown = protonect_shutdown || (key > 0 && ((key & 0xFF) == 27)); // shutdown on escape
+		}
+		else
+			usleep(100000);
+	}
+	protonect_shutdown = true;
+
+	for(size_t i = 0; i < pipelines.size(); i++)
+	{
+		pthread_join(pipelines[i].thread, NULL);
+		pthread_mutex_destroy(&pipelines[i].mutex);
+		std::cout << pipelines[i].spec << ": " << pipelines[i].frames << " frames in " << pipelines[i].seconds << " s (" << pipelines[i].frames/pipelines[i].seconds << " fps)" << std::endl;
+		pipelines[i].latency.report(std::cout);
+		delete pipelines[i].source;
+	}
+
+	return 0;
 }
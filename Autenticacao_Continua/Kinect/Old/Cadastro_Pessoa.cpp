@@ -41,6 +41,10 @@
 #include "opencv2/objdetect/objdetect.hpp"
 #include <opencv2/video/tracking.hpp>
 
+#define FRAME_SOURCE_KINECT
+#include "Fonte_Quadros.hpp"
+#include "Registro_Cascatas.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -86,14 +90,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   string lsRightEye_haar = "/home/matheusm/Cascades/haarcascade_mcs_righteye_alt.xml";
   string lsBothEyes_haar = "/home/matheusm/Cascades/haarcascade_eye.xml";
 
-  CascadeClassifier haar_cascade;
-  haar_cascade.load(lsLeftEye_haar);
+  // Loaded once per thread, see Registro_Cascatas.hpp
+  CascadeClassifier *haar_cascade = &cascade(lsLeftEye_haar);
 
   vector< Rect_<int> > detectedRightEye;
   vector< Rect_<int> > detectedLeftEye;
   Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
   // Find the left eye:
-  haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+  haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
   for(int i = 0; i < detectedLeftEye.size(); i++) {
     Rect eye_i = detectedLeftEye[i];
     eye_i.x += leftX;
@@ -103,8 +107,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedLeftEye.empty()) {
-    haar_cascade.load(lsBothEyes_haar);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+    haar_cascade = &cascade(lsBothEyes_haar);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
     for(int i = 0; i < detectedLeftEye.size(); i++) {
       Rect eye_i = detectedLeftEye[i];
       eye_i.x += leftX;
@@ -113,8 +117,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
       //rectangle(face, eye_i, CV_RGB(255, 255, 255), 1);
     }
   }
-  haar_cascade.load(lsRightEye_haar);
-  haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+  haar_cascade = &cascade(lsRightEye_haar);
+  haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
   for(int i = 0; i < detectedRightEye.size(); i++) {
     Rect eye_i = detectedRightEye[i];
     eye_i.x += rightX;;
@@ -123,8 +127,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
     //rectangle(face, eye_i, CV_RGB(255, 255, 255), 1);
   }
   if(detectedRightEye.empty()) {
-    haar_cascade.load(lsBothEyes_haar);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+    haar_cascade = &cascade(lsBothEyes_haar);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
     for(int i = 0; i < detectedRightEye.size(); i++) {
       Rect eye_i = detectedRightEye[i];
       eye_i.x += leftX;
@@ -274,28 +278,19 @@ int main(int argc, char *argv[])
   }
 
 
-  libfreenect2::Freenect2 freenect2;
-  libfreenect2::Freenect2Device *dev = freenect2.openDefaultDevice();
-
-  if(dev == 0)
+  // Source: kinect[:serial] (default), bus[:name] to enroll while other programs use the sensor,
+  // a .rec recording or an image list
+  std::string spec = argc > 1 ? argv[1] : "kinect";
+  FrameSource *source = open_frame_source(spec);
+  if(source == 0)
   {
-    std::cout << "no device connected or failure opening the default one!" << std::endl;
+    std::cout << "could not open " << spec << std::endl;
     return -1;
   }
 
   signal(SIGINT,sigint_handler);
   protonect_shutdown = false;
 
-  libfreenect2::SyncMultiFrameListener listener(libfreenect2::Frame::Color | libfreenect2::Frame::Ir | libfreenect2::Frame::Depth);
-  libfreenect2::FrameMap frames;
-
-  dev->setColorFrameListener(&listener);
-  dev->setIrAndDepthFrameListener(&listener);
-  dev->start();
-
-  std::cout << "device serial: " << dev->getSerialNumber() << std::endl;
-  std::cout << "device firmware: " << dev->getFirmwareVersion() << std::endl;
-
   CascadeClassifier haar_cascade;
   haar_cascade.load(PATH_CASCADE_FACE);
 
@@ -306,13 +301,11 @@ int main(int argc, char *argv[])
   // Get OpenCV to automatically call my "onMouse()" function when the user clicks in the GUI window.
   setMouseCallback("Cadastrar Pessoa", onMouse, 0);
 
-  while(!protonect_shutdown)
+  SourceFrame input;
+  while(!protonect_shutdown && source->read(input))
   {
     int key = cv::waitKey(1);
-    listener.waitForNewFrame(frames);
-    libfreenect2::Frame *ir = frames[libfreenect2::Frame::Ir];
-    Mat frame = cv::Mat(ir->height, ir->width, CV_32FC1, ir->data)/ 80000;
-    frame.convertTo(frame, CV_8UC3, 255, 0);
+    Mat frame = input.image.clone();
     vector< Rect_<int> > faces;
     cout << frame_count++ << endl;
     haar_cascade.detectMultiScale(frame, faces);
@@ -347,12 +340,9 @@ int main(int argc, char *argv[])
     protonect_shutdown = protonect_shutdown || (key > 0 && ((key & 0xFF) == 27)); // shutdown on escape
     if(numFaces > 100)
       protonect_shutdown = true;
-   
-    listener.release(frames);
   }
 
-  dev->stop();
-  dev->close();
+  delete source;
 
   return 0;
 }
@@ -15,6 +15,9 @@
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/objdetect/objdetect.hpp"
 
+#define FRAME_SOURCE_KINECT
+#include "Fonte_Quadros.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -31,9 +34,12 @@ void sigint_handler(int s)
   protonect_shutdown = true;
 }
 
+const string PATH_RECORD = "/home/matheusm/Record/video.rec";
+
 int main(int argc, char *argv[])
 {
 	std::string program_path(argv[0]);
+    std::string record_path = argc > 1 ? argv[1] : PATH_RECORD;
     size_t executable_name_idx = program_path.rfind("Protonect");
 
     std::string binpath = "/";
@@ -44,50 +50,56 @@ int main(int argc, char *argv[])
     }
 
 
-    libfreenect2::Freenect2 freenect2;
-    libfreenect2::Freenect2Device *dev = freenect2.openDefaultDevice();
-
-    if(dev == 0)
+    // Source: kinect[:serial] (default, every frame is recorded - the ring absorbs slow writes)
+    // or bus[:name] to record while other programs use the sensor
+    std::string spec = argc > 2 ? argv[2] : "kinect";
+    FrameSource *source = open_frame_source(spec, true);
+    if(source == 0)
     {
-        std::cout << "no device connected or failure opening the default one!" << std::endl;
+        std::cout << "could not open " << spec << std::endl;
         return -1;
     }
 
     signal(SIGINT,sigint_handler);
     protonect_shutdown = false;
 
-    libfreenect2::SyncMultiFrameListener listener(libfreenect2::Frame::Color | libfreenect2::Frame::Ir | libfreenect2::Frame::Depth);
-    libfreenect2::FrameMap frames;
-
-    dev->setColorFrameListener(&listener);
-    dev->setIrAndDepthFrameListener(&listener);
-    dev->start();
-
-    std::cout << "device serial: " << dev->getSerialNumber() << std::endl;
-    std::cout << "device firmware: " << dev->getFirmwareVersion() << std::endl;
-
-    int frames_saved = 0;
-    cout << getTickFrequency() << endl;
-    while(!protonect_shutdown)
+    // Frames go to a background writer; recording stops on escape or Ctrl-C.
+    // The recording takes the format of the first frame and the clock of the source (the sensor
+    // one for live frames); frames of another format are skipped
+    FrameRecorder recorder;
+    bool opened = false;
+    int frames_saved = 0, frames_skipped = 0;
+    SourceFrame input;
+    Mat frame;
+    while(!protonect_shutdown && source->read(input))
     {
-    	listener.waitForNewFrame(frames);
-        libfreenect2::Frame *ir = frames[libfreenect2::Frame::Ir];
-        Mat frame = cv::Mat(ir->height, ir->width, CV_32FC1, ir->data)/ 80000;
-        frame.convertTo(frame, CV_8UC3, 255, 0);
+        if(!opened && !(opened = recorder.open(record_path, input.image.cols, input.image.rows, input.image.type(), source->clock())))
+        {
+            std::cout << "could not create " << record_path << std::endl;
+            break;
+        }
+        if(!recorder.record(input.image, input.sequence, input.timestamp))
+        {
+            frames_skipped++;
+            continue;
+        }
+        input.image.copyTo(frame);
         frames_saved++;
-        cv::imwrite(format("/home/matheusm/Record/frame%d.pgm", frames_saved), frame);
         string mesage = format("Imagem salva numero %d", frames_saved);
         putText(frame, mesage, Point(8, frame.rows - 8), FONT_HERSHEY_PLAIN, 1.2, CV_RGB(255,255,255), 1.0);
         cv::imshow("Record Video", frame);
         int key = cv::waitKey(1);
         protonect_shutdown = protonect_shutdown || (key > 0 && ((key & 0xFF) == 27)); // shutdown on escape
-        if(frames_saved > 1004)
-            protonect_shutdown = true;
-        listener.release(frames);
     }
 
-    dev->stop();
-    dev->close();
+    delete source;
+    if(!opened)
+        return -1;
+    if(!recorder.close())
+        std::cout << "write error - " << record_path << " is incomplete" << std::endl;
+    std::cout << recorder.frames() << " frames saved to " << record_path << std::endl;
+    if(frames_skipped)
+        std::cout << frames_skipped << " frames skipped (size or type differs from the first frame)" << std::endl;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <signal.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener_impl.h>
+#include <libfreenect2/threading.h>
+
+#include "Captura_Kinect2.hpp"
+#include "Gravacao_Kinect2.hpp"
+#include "Conversao_IR.hpp"
+
+using namespace cv;
+using namespace std;
+
+bool protonect_shutdown = false;
+
+void sigint_handler(int s)
+{
+  protonect_shutdown = true;
+}
+
+const string PATH_RECORD = "/home/matheusm/Record/video";
+
+// Records IR, depth and optionally colour of every frame set into <prefix>_ir.rec (8-bit, as
+// Gravar_Video), <prefix>_depth.rec (16-bit mm, lossless codec) and <prefix>_color.rec (JPEG).
+// Every file records the sensor sequence number and timestamp of the frame set (RECORD_CLOCK_SENSOR), as
+// Gravar_Video does, so the files replay in sync with each other and with Gravar_Video recordings.
+int main(int argc, char *argv[])
+{
+    std::string prefix = PATH_RECORD;
+    bool color = false;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if(arg == "color")
+            color = true;
+        else
+            prefix = arg;
+    }
+
+    libfreenect2::Freenect2 freenect2;
+    libfreenect2::Freenect2Device *dev = freenect2.openDefaultDevice();
+
+    if(dev == 0)
+    {
+        std::cout << "no device connected or failure opening the default one!" << std::endl;
+        return -1;
+    }
+
+    signal(SIGINT,sigint_handler);
+    protonect_shutdown = false;
+
+    // Every frame set is recorded - the ring absorbs slow writes (colour slots are 8 MB each)
+    unsigned int types = libfreenect2::Frame::Ir | libfreenect2::Frame::Depth | (color ? libfreenect2::Frame::Color : 0);
+    KinectCapture capture(dev, types, CAPTURE_QUEUE, color ? 16 : 64);
+    capture.start();
+
+    std::cout << "device serial: " << dev->getSerialNumber() << std::endl;
+    std::cout << "device firmware: " << dev->getFirmwareVersion() << std::endl;
+
+    // One writer thread per stream; the depth and colour encoders run there
+    FrameRecorder ir_recorder, depth_recorder, color_recorder;
+    if(!ir_recorder.open(prefix + "_ir.rec", 512, 424, CV_8UC1, RECORD_CLOCK_SENSOR) ||
+       !depth_recorder.open(prefix + "_depth.rec", 512, 424, CV_16UC1, RECORD_CLOCK_SENSOR, RECORD_LOSSLESS) ||
+       (color && !color_recorder.open(prefix + "_color.rec", 1920, 1080, CV_8UC3, RECORD_CLOCK_SENSOR, RECORD_JPEG, 8)))
+    {
+        std::cout << "could not create the recordings " << prefix << "_*.rec" << std::endl;
+        capture.stop();
+        dev->close();
+        return -1;
+    }
+
+    IrConverter converter;
+    Mat ir, depth, bgr;
+    int frames_saved = 0;
+    while(!protonect_shutdown)
+    {
+        CaptureFrame *frame = capture.acquire();
+        if(!frame)
+            break;
+        unsigned int sequence = frame->sensor_sequence;
+        int64 timestamp = frame->sensor_timestamp;
+        converter.convert(frame->ir, ir);
+        frame->depth.convertTo(depth, CV_16UC1);
+        ir_recorder.record(ir, sequence, timestamp);
+        depth_recorder.record(depth, sequence, timestamp);
+        if(color)
+        {
+            if(frame->color.channels() == 4)
+                cvtColor(frame->color, bgr, CV_BGRA2BGR);
+            else
+                bgr = frame->color;
+            color_recorder.record(bgr, sequence, timestamp);
+        }
+        capture.release(frame);
+        frames_saved++;
+        string mesage = format("Quadros salvos %d", frames_saved);
+        putText(ir, mesage, Point(8, ir.rows - 8), FONT_HERSHEY_PLAIN, 1.2, CV_RGB(255,255,255), 1.0);
+        cv::imshow("Record Video", ir);
+        int key = cv::waitKey(1);
+        protonect_shutdown = protonect_shutdown || (key > 0 && ((key & 0xFF) == 27)); // shutdown on escape
+    }
+
+    capture.stop();
+    bool ok = ir_recorder.close();
+    ok = depth_recorder.close() && ok;
+    ok = (!color || color_recorder.close()) && ok;
+    if(!ok)
+        std::cout << "write error - " << prefix << "_*.rec are incomplete" << std::endl;
+    std::cout << ir_recorder.frames() << " frame sets saved to " << prefix << "_*.rec" << std::endl;
+    std::cout << "frames captured: " << capture.captured() << ", dropped: " << capture.dropped() << std::endl;
+    dev->close();
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <signal.h>
+
+#include <opencv2/opencv.hpp>
+
+#define FRAME_SOURCE_KINECT
+#include "Fonte_Quadros.hpp"
+
+using namespace cv;
+using namespace std;
+
+bool protonect_shutdown = false;
+
+void sigint_handler(int s)
+{
+  protonect_shutdown = true;
+}
+
+// Capture daemon: publishes a frame source on the shared-memory frame bus, so Gravar_Video,
+// Cadastro_Pessoa and Autenticacao_Continua_NIR can share one Kinect (source "bus[:name]").
+// Usage: Publicar_Quadros [source] [bus name]
+// The source is kinect[:serial] (default), kinect-depth[:serial], a .rec recording (replayed at its
+// pace, in place of the device) or an image list.
+int main(int argc, char *argv[])
+{
+    std::string spec = argc > 1 ? argv[1] : "kinect";
+    std::string name = argc > 2 ? argv[2] : BUS_NAME;
+
+    FrameSource *source = open_frame_source(spec);
+    if(source == 0)
+    {
+        std::cout << "could not open " << spec << std::endl;
+        return -1;
+    }
+    source->set_paced(true);
+    signal(SIGINT,sigint_handler);
+    protonect_shutdown = false;
+
+    // The bus takes the format of the first frame
+    FrameBusPublisher bus;
+    SourceFrame input;
+    bool opened = false;
+    while(!protonect_shutdown && source->read(input))
+    {
+        if(!opened && !(opened = bus.open(name, input.image.cols, input.image.rows, input.image.type(), source->clock())))
+        {
+            std::cout << "could not create the frame bus " << name << std::endl;
+            break;
+        }
+        bus.publish(input.image, input.sequence, input.timestamp, input.acquired);
+    }
+
+    std::cout << "frames published: " << bus.published() << ", dropped (all slots in use or another format): " << bus.dropped() << std::endl;
+    bus.close();
+    delete source;
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <cstdlib>
+
+#include <opencv2/opencv.hpp>
+
+#include "Gravacao_Kinect2.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Plays a recording made by Gravar_Video or Gravar_Video_Multimodal at its recorded pace.
+// Keys: space pauses, a/d step while paused, s saves the current frame, escape quits.
+int main(int argc, char *argv[])
+{
+    FrameRecording recording;
+
+    if(argc < 2)
+    {
+        cout << "Usage: " << argv[0] << " <video.rec> [first frame]" << endl;
+        return -1;
+    }
+    if(!recording.open(argv[1]) || !recording.frames())
+    {
+        cout << "could not read " << argv[1] << endl;
+        return -1;
+    }
+    cout << recording.frames() << " frames, " << recording.width() << "x" << recording.height() << ", "
+         << (recording.clock() == RECORD_CLOCK_SENSOR ? "sensor" : "host") << " timestamps" << endl;
+
+    int i = argc > 2 ? min(max(atoi(argv[2]), 0), (int) recording.frames()-1) : 0;
+    bool paused = false;
+    for(;;)
+    {
+        // Depth recordings (16-bit mm) are shown over the sensor range
+        Mat frame;
+        if(recording.type() == CV_16UC1)
+            recording.frame(i).convertTo(frame, CV_8UC1, 255.0/4500.0);
+        else
+            frame = recording.frame(i).clone();
+        putText(frame, format("%d/%d", i, recording.frames()-1), Point(8, frame.rows - 8), FONT_HERSHEY_PLAIN, 1.2, CV_RGB(255,255,255), 1.0);
+        imshow("Play Video", frame);
+
+        // Wait the recorded interval to the next frame
+        int delay = 0;
+        if(!paused && i+1 < (int) recording.frames())
+            delay = max((int) ((recording.timestamp(i+1)-recording.timestamp(i))/1000), 1);
+        int key = waitKey(delay) & 0xFF;
+
+        if(key == 27)
+            break;
+        else if(key == ' ')
+            paused = !paused;
+        else if(key == 's')
+            imwrite(format("frame%d.pgm", i), recording.frame(i));
+        else if(paused && key == 'a')
+            i = max(i-1, 0);
+        else if(paused && key == 'd')
+            i = min(i+1, (int) recording.frames()-1);
+        else if(!paused)
+        {
+            if(i+1 == (int) recording.frames())
+                paused = true;
+            else
+                i++;
+        }
+    }
+
+    return 0;
+}
@@ -15,6 +15,8 @@
 #include <sstream>
 #include <vector>
 
+#include "Registro_Cascatas.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -48,14 +50,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   string lsRightEye_haar = "/home/matheusm/Cascades/haarcascade_mcs_righteye_alt.xml";
   string lsBothEyes_haar = "/home/matheusm/Cascades/haarcascade_eye.xml";
 
-  CascadeClassifier haar_cascade;
-  haar_cascade.load(lsLeftEye_haar);
+  // Loaded once per thread, see Registro_Cascatas.hpp
+  CascadeClassifier *haar_cascade = &cascade(lsLeftEye_haar);
 
   vector< Rect_<int> > detectedRightEye;
   vector< Rect_<int> > detectedLeftEye;
   Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
   // Find the left eye:
-  haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+  haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
   for(int i = 0; i < detectedLeftEye.size(); i++) {
     Rect eye_i = detectedLeftEye[i];
     eye_i.x += leftX;
@@ -64,8 +66,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedLeftEye.empty()) {
-    haar_cascade.load(lsBothEyes_haar);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+    haar_cascade = &cascade(lsBothEyes_haar);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
     for(int i = 0; i < detectedLeftEye.size(); i++) {
       Rect eye_i = detectedLeftEye[i];
       eye_i.x += leftX;
@@ -73,8 +75,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
       leftEye = Point(eye_i.x + eye_i.width/2, eye_i.y + eye_i.height/2);
     }
   }
-  haar_cascade.load(lsRightEye_haar);
-  haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+  haar_cascade = &cascade(lsRightEye_haar);
+  haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
   for(int i = 0; i < detectedRightEye.size(); i++) {
     Rect eye_i = detectedRightEye[i];
     eye_i.x += rightX;;
@@ -82,8 +84,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
     rightEye = Point(eye_i.x + eye_i.width/2, eye_i.y + eye_i.height/2);
   }
   if(detectedRightEye.empty()) {
-    haar_cascade.load(lsBothEyes_haar);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+    haar_cascade = &cascade(lsBothEyes_haar);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
     for(int i = 0; i < detectedRightEye.size(); i++) {
       Rect eye_i = detectedRightEye[i];
       eye_i.x += leftX;
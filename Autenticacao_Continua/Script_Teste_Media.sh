@@ -1,5 +1,5 @@
 #!/bin/sh
-g++ Calculo_Variancia_Dinamico.cpp `pkg-config --cflags --libs opencv`
+g++ -I.. Calculo_Variancia_Dinamico.cpp `pkg-config --cflags --libs opencv` -lpthread -lrt
 echo '1x2'
 ./a.out /home/matheusm/Record/1x2.txt > m1x2.txt
 echo '1x3'
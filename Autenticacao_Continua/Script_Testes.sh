@@ -1,5 +1,5 @@
 !/bin/bash
-g++ Teste_Video_PSafe.cpp `pkg-config --cflags --libs opencv`
+g++ -I.. Teste_Video_PSafe.cpp `pkg-config --cflags --libs opencv` -lpthread -lrt
 echo '1'
 ./a.out /home/matheusm/Record/framesVideoSujeito1.txt > sujeito1.txt
 echo '2'
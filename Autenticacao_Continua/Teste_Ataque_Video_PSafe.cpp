@@ -11,6 +11,8 @@
 #include "opencv2/objdetect/objdetect.hpp"
 #include <opencv2/video/tracking.hpp>
 
+#include "Registro_Cascatas.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -68,14 +70,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   Mat topLeftOfFace = face(Rect(leftX, topY, widthX, heightY));
   Mat topRightOfFace = face(Rect(rightX, topY, widthX, heightY));
 
-  CascadeClassifier haar_cascade;
-  haar_cascade.load(PATH_CASCADE_LEFTEYE);
+  // Loaded once per thread, see Registro_Cascatas.hpp
+  CascadeClassifier *haar_cascade = &cascade(PATH_CASCADE_LEFTEYE);
 
   vector< Rect_<int> > detectedRightEye;
   vector< Rect_<int> > detectedLeftEye;
   Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
   // Find the left eye:
-  haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+  haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
   for(int i = 0; i < detectedLeftEye.size(); i++) {
     Rect eye_i = detectedLeftEye[i];
     eye_i.x += leftX;
@@ -84,8 +86,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedLeftEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
     for(int i = 0; i < detectedLeftEye.size(); i++) {
       Rect eye_i = detectedLeftEye[i];
       eye_i.x += leftX;
@@ -94,8 +96,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
     }
   }
   //Find the right eye
-  haar_cascade.load(PATH_CASCADE_RIGHTEYE);
-  haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+  haar_cascade = &cascade(PATH_CASCADE_RIGHTEYE);
+  haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
   for(int i = 0; i < detectedRightEye.size(); i++) {
     Rect eye_i = detectedRightEye[i];
     eye_i.x += rightX;;
@@ -104,8 +106,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedRightEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
     for(int i = 0; i < detectedRightEye.size(); i++) {
       Rect eye_i = detectedRightEye[i];
       eye_i.x += leftX;
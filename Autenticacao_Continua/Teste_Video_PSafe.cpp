@@ -11,6 +11,9 @@
 #include "opencv2/objdetect/objdetect.hpp"
 #include <opencv2/video/tracking.hpp>
 
+#include "Fonte_Quadros.hpp"
+#include "Registro_Cascatas.hpp"
+
 const double FACE_ELLIPSE_CY = 0.40;
 const double FACE_ELLIPSE_W = 0.45;         // Should be atleast 0.5
 const double FACE_ELLIPSE_H = 0.80;     //0.80
@@ -74,14 +77,14 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   Mat topLeftOfFace = face(Rect(leftX, topY, widthX, heightY));
   Mat topRightOfFace = face(Rect(rightX, topY, widthX, heightY));
 
-  CascadeClassifier haar_cascade;
-  haar_cascade.load(PATH_CASCADE_LEFTEYE);
+  // Loaded once per thread, see Registro_Cascatas.hpp
+  CascadeClassifier *haar_cascade = &cascade(PATH_CASCADE_LEFTEYE);
 
   vector< Rect_<int> > detectedRightEye;
   vector< Rect_<int> > detectedLeftEye;
   Point leftEye = Point(-1, -1), rightEye = Point(-1, -1);
   // Find the left eye:
-  haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+  haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
   for(int i = 0; i < detectedLeftEye.size(); i++) {
     Rect eye_i = detectedLeftEye[i];
     eye_i.x += leftX;
@@ -90,8 +93,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedLeftEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedLeftEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedLeftEye);
     for(int i = 0; i < detectedLeftEye.size(); i++) {
       Rect eye_i = detectedLeftEye[i];
       eye_i.x += leftX;
@@ -100,8 +103,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
     }
   }
   //Find the right eye
-  haar_cascade.load(PATH_CASCADE_RIGHTEYE);
-  haar_cascade.detectMultiScale(topRightOfFace, detectedRightEye);
+  haar_cascade = &cascade(PATH_CASCADE_RIGHTEYE);
+  haar_cascade->detectMultiScale(topRightOfFace, detectedRightEye);
   for(int i = 0; i < detectedRightEye.size(); i++) {
     Rect eye_i = detectedRightEye[i];
     eye_i.x += rightX;;
@@ -110,8 +113,8 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   }
   // If cascade fails, try another
   if(detectedRightEye.empty()) {
-    haar_cascade.load(PATH_CASCADE_BOTHEYES);
-    haar_cascade.detectMultiScale(topLeftOfFace, detectedRightEye);
+    haar_cascade = &cascade(PATH_CASCADE_BOTHEYES);
+    haar_cascade->detectMultiScale(topLeftOfFace, detectedRightEye);
     for(int i = 0; i < detectedRightEye.size(); i++) {
       Rect eye_i = detectedRightEye[i];
       eye_i.x += leftX;
@@ -259,22 +262,6 @@ Mat faceNormalize(Mat face, int desiredFaceWidth, bool &sucess) {
   return dstImg;
 }
 
- void read_csv(const string& filename, vector<Mat>& images, char separator = ';') {
-    std::ifstream file(filename.c_str(), ifstream::in);
-    if (!file) {
-        string error_message = "No valid input file was given, please check the given filename.";
-        CV_Error(CV_StsBadArg, error_message);
-    }
-    string line, path, classlabel;
-    while (getline(file, line)) {
-        stringstream liness(line);
-        getline(liness, path, separator);
-        if(!path.empty()) {
-            images.push_back(imread(path, 0));
-        }
-    }
-}
-
 int main(int argc, char *argv[])
 {
 	//KALMAN
@@ -294,7 +281,6 @@ int main(int argc, char *argv[])
 
     // These vectors hold the images and corresponding labels:
     vector<Mat> images;
-    vector<Mat> video;
     vector<int> labels;
     /*try {
         read_csv(PATH_CSV_FACES, images, labels);
@@ -311,11 +297,11 @@ int main(int argc, char *argv[])
     Ptr<FaceRecognizer> model = createLBPHFaceRecognizer();
 
     //model->train(images, labels);
+    // Image list (CSV) or recording, streamed frame by frame
     string path = argv[1];
-    try {
-        read_csv(path, video);
-    } catch (cv::Exception& e) {
-        cerr << "Error opening file \"" << path << "\". Reason: " << e.msg << endl;
+    FrameSource *video = open_frame_source(path);
+    if(!video) {
+        cerr << "Error opening file \"" << path << "\"." << endl;
         exit(1);
     }
 
@@ -324,14 +310,16 @@ int main(int argc, char *argv[])
     bool sucess = false;
     int login = 0;
     Point ultimaFace = Point(-1, -1);
-    for(int i = 0; i < video.size(); i++)
+    SourceFrame input;
+    while(video->read(input))
     {
-    	   Mat frame = video[i];
+    	   Mat frame = input.image;
         //frame.convertTo(frame, CV_8UC3, 255, 0);
         vector< Rect_<int> > faces;
         // Find the faces in the frame:
         haar_cascade.detectMultiScale(frame, faces);
-        tempo = getTickCount();
+        // Frame time, so the decay does not depend on how fast frames are read
+        tempo = input.timestamp*getTickFrequency()/1000000.0;
         for(int j = 0; j < faces.size(); j++) {
          	    Mat face = frame(faces[j]);
 		    Rect faceRect = faces[j];
@@ -395,5 +383,6 @@ int main(int argc, char *argv[])
         }
 
     }
+    delete video;
     return 0;
 }
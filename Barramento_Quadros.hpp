@@ -0,0 +1,315 @@
+// Shared-memory frame bus: one publisher process (Publicar_Quadros) and any number of local
+// consumers. Frames live in a ring of slots in a POSIX shared memory object; consumers map it and
+// read the frames in place (the pixels are mapped read-only).
+//
+// Slots are reference counted: refs is -1 while the publisher writes a slot and the number of
+// consumers reading it otherwise. The publisher only reuses slots that nobody reads and drops the
+// frame when there is none, so it never waits. Consumers always take the newest frame, so a slow
+// consumer only skips frames. Consumers that die holding a slot are found by pid and released.
+// Frames carry the time they reached the host in the publisher (getTickCount() is the system
+// monotonic clock, common to every process), so consumers can account for the latency of the bus.
+// The header says which clock the sequence numbers and timestamps are on (a RecordClock: the sensor
+// one for live frames), as the recordings do.
+
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/opencv.hpp>
+
+#define BUS_MAGIC "KV2BUS03"
+#define BUS_NAME "/kv2bus"          // Default shared memory object
+#define BUS_SLOTS 8                 // Default ring size (consumers + 2 always leaves one free)
+#define BUS_CONSUMERS 16            // Most consumers attached at once
+#define BUS_POLL_US 500             // Consumer polling interval while there is no new frame
+#define BUS_REAP_FRAMES 30          // Dead consumers are looked for every BUS_REAP_FRAMES frames
+
+struct BusSlot {
+  volatile int32_t refs;            // -1 while written, else consumers reading it
+  volatile uint32_t count;          // Frames published up to this one, from 1
+  volatile uint32_t sequence;       // Source frame number (gaps are dropped frames)
+  volatile int64_t timestamp;       // In microseconds
+  volatile int64_t acquired;        // Host arrival on the getTickCount() clock - in microseconds
+};
+
+struct BusConsumer {
+  volatile int32_t pid;             // 0 if the entry is free
+  volatile int32_t slot;            // Slot being read, -1 if none
+};
+
+struct BusHeader {
+  char magic[8];
+  int32_t width, height, type, slots;
+  uint64_t slot_size;               // Pixel bytes per slot
+  uint64_t pixels;                  // Offset of slot 0 pixels (page aligned)
+  int32_t clock;                    // RecordClock of the sequence numbers and timestamps
+  volatile int32_t latest;          // Slot of the newest frame, -1 before the first
+  volatile int32_t publisher;       // pid, 0 once the publisher closed
+  volatile uint32_t published, dropped;
+  BusConsumer consumers[BUS_CONSUMERS];
+};
+
+// Shared memory object of a bus name ("kv2bus" or "/kv2bus")
+static inline std::string bus_object(const std::string &name) {
+  return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+static inline bool bus_process_alive(int pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+class FrameBusPublisher {
+public:
+  FrameBusPublisher() : header(0), frames(0) {}
+  ~FrameBusPublisher() { close(); }
+
+  // clock is the RecordClock of the sequence numbers and timestamps given to publish()
+  bool open(const std::string &name, int width, int height, int type, int clock, int slots = BUS_SLOTS) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    int fd;
+
+    if(header)
+      return false;
+    this->name = bus_object(name);
+    slots = std::max(slots, 2);
+    slot_size = (uint64_t) width*height*CV_ELEM_SIZE(type);
+    pixels = (sizeof(BusHeader)+slots*sizeof(BusSlot)+page-1)/page*page;
+    size = pixels+slots*slot_size;
+
+    // A new object each time - consumers of a previous publisher keep their own until they detach
+    shm_unlink(this->name.c_str());
+    fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if(fd < 0)
+      return false;
+    if(ftruncate(fd, size)) {
+      ::close(fd);
+      shm_unlink(this->name.c_str());
+      return false;
+    }
+    data = (uchar *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+      shm_unlink(this->name.c_str());
+      return false;
+    }
+
+    header = (BusHeader *) data;
+    slot = (BusSlot *) (data+sizeof(BusHeader));
+    header->width = width;
+    header->height = height;
+    header->type = type;
+    header->slots = slots;
+    header->slot_size = slot_size;
+    header->pixels = pixels;
+    header->clock = clock;
+    header->latest = -1;
+    header->publisher = getpid();
+    for(int i = 0; i < BUS_CONSUMERS; i++)
+      header->consumers[i].slot = -1;
+    next = 0;
+    // Consumers check the magic, so it goes last
+    __sync_synchronize();
+    memcpy(header->magic, BUS_MAGIC, 8);
+    return true;
+  }
+
+  // Copies the frame into a slot nobody reads; false (frame dropped) if every slot is in use or the
+  // frame is not of the size and type given to open()
+  bool publish(const cv::Mat &frame, unsigned int sequence, int64 timestamp, int64 acquired) {
+    int i, k, n = header->slots;
+
+    if(frame.cols != header->width || frame.rows != header->height || frame.type() != header->type) {
+      __sync_fetch_and_add(&header->dropped, 1);
+      return false;
+    }
+
+    if(++frames % BUS_REAP_FRAMES == 0)
+      reap();
+
+    for(k = 0; k < n; k++) {
+      i = (next+k) % n;
+      if(i != header->latest && __sync_bool_compare_and_swap(&slot[i].refs, 0, -1))
+        break;
+    }
+    if(k == n) {
+      __sync_fetch_and_add(&header->dropped, 1);
+      return false;
+    }
+
+    cv::Mat target(header->height, header->width, header->type, data+pixels+i*slot_size);
+    frame.copyTo(target);
+    slot[i].count = header->published+1;
+    slot[i].sequence = sequence;
+    slot[i].timestamp = timestamp;
+    slot[i].acquired = acquired;
+    __sync_synchronize();
+    slot[i].refs = 0;
+    __sync_synchronize();
+    header->latest = i;
+    __sync_fetch_and_add(&header->published, 1);
+    next = (i+1) % n;
+    return true;
+  }
+
+  // Consumers see the bus end once they have read the last frame
+  void close() {
+    if(!header)
+      return;
+    header->publisher = 0;
+    munmap(data, size);
+    shm_unlink(name.c_str());
+    header = 0;
+  }
+
+  unsigned int published() const { return header ? header->published : 0; }
+  unsigned int dropped() const { return header ? header->dropped : 0; }
+
+private:
+  // Releases the slots held by consumers that exited without detaching
+  void reap() {
+    for(int i = 0; i < BUS_CONSUMERS; i++) {
+      BusConsumer *consumer = &header->consumers[i];
+      int pid = consumer->pid;
+      if(!pid || bus_process_alive(pid))
+        continue;
+      if(consumer->slot >= 0)
+        __sync_fetch_and_sub(&slot[consumer->slot].refs, 1);
+      consumer->slot = -1;
+      __sync_bool_compare_and_swap(&consumer->pid, pid, 0);
+    }
+  }
+
+  std::string name;
+  uchar *data;
+  uint64_t size, slot_size, pixels;
+  BusHeader *header;
+  BusSlot *slot;
+  int next;                         // Where the search for a free slot starts
+  unsigned int frames;
+};
+
+class FrameBusConsumer {
+public:
+  FrameBusConsumer() : pixels(0), header(0), entry(-1), held(-1), last(0) {}
+  ~FrameBusConsumer() { close(); }
+
+  bool open(const std::string &name = BUS_NAME) {
+    struct stat st;
+    int fd, i;
+
+    if(header)
+      return false;
+    fd = shm_open(bus_object(name).c_str(), O_RDWR, 0);
+    if(fd < 0)
+      return false;
+    if(fstat(fd, &st) || (size_t) st.st_size < sizeof(BusHeader)) {
+      ::close(fd);
+      return false;
+    }
+    data = (uchar *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+    size = st.st_size;
+    header = (BusHeader *) data;
+    if(memcmp(header->magic, BUS_MAGIC, 8) || header->pixels+header->slots*header->slot_size != size) {
+      ::close(fd);
+      close();
+      return false;
+    }
+    slot = (BusSlot *) (data+sizeof(BusHeader));
+
+    // Pixels again, read-only, so a consumer cannot corrupt the frames of the others
+    pixels = (uchar *) mmap(NULL, size-header->pixels, PROT_READ, MAP_SHARED, fd, header->pixels);
+    ::close(fd);
+    if(pixels == MAP_FAILED) {
+      pixels = 0;
+      close();
+      return false;
+    }
+
+    for(i = 0; i < BUS_CONSUMERS; i++)
+      if(__sync_bool_compare_and_swap(&header->consumers[i].pid, 0, (int32_t) getpid()))
+        break;
+    if(i == BUS_CONSUMERS) {
+      close();
+      return false;
+    }
+    entry = i;
+    header->consumers[entry].slot = -1;
+    return true;
+  }
+
+  // Newest frame not yet returned, waiting for one; the image is valid until release().
+  // false once the publisher is gone
+  bool acquire(cv::Mat &image, unsigned int &sequence, int64 &timestamp, int64 &acquired) {
+    int i, refs;
+
+    release();
+    for(;;) {
+      i = header->latest;
+      if(i < 0 || slot[i].count == last) {
+        if(!bus_process_alive(header->publisher))
+          return false;
+        usleep(BUS_POLL_US);
+        continue;
+      }
+      refs = slot[i].refs;
+      if(refs < 0 || !__sync_bool_compare_and_swap(&slot[i].refs, refs, refs+1))
+        continue;
+      header->consumers[entry].slot = i;
+      held = i;
+
+      // The slot may have been reused for a newer frame before we claimed it, never an older one
+      __sync_synchronize();
+      if(slot[i].count == last) {
+        release();
+        continue;
+      }
+      last = slot[i].count;
+      sequence = slot[i].sequence;
+      timestamp = slot[i].timestamp;
+      acquired = slot[i].acquired;
+      image = cv::Mat(header->height, header->width, header->type, pixels+(uint64_t) i*header->slot_size);
+      return true;
+    }
+  }
+
+  int clock() const { return header->clock; }
+
+  void release() {
+    if(held < 0)
+      return;
+    header->consumers[entry].slot = -1;
+    __sync_fetch_and_sub(&slot[held].refs, 1);
+    held = -1;
+  }
+
+  void close() {
+    if(!header)
+      return;
+    release();
+    if(entry >= 0)
+      header->consumers[entry].pid = 0;
+    entry = -1;
+    if(pixels)
+      munmap(pixels, size-header->pixels);
+    munmap(data, size);
+    header = 0;
+    pixels = 0;
+  }
+
+private:
+  uchar *data, *pixels;
+  uint64_t size;
+  BusHeader *header;
+  BusSlot *slot;
+  int entry, held;
+  unsigned int last;                // Count of the last frame returned
+};
@@ -0,0 +1,233 @@
+// Asynchronous Kinect v2 acquisition
+//
+// A capture thread waits on libfreenect2, copies each frame into a ring of preallocated slots and
+// releases it at once, so slow processing never stalls the sensor. Slots change state with atomic
+// compare-and-swap only (no locks). One thread consumes with acquire()/release().
+//
+// CAPTURE_NEWEST: acquire() returns the freshest frame; older unread frames are dropped.
+// CAPTURE_QUEUE: acquire() returns every frame in order; new frames are dropped only if the ring is full.
+//
+// Each slot keeps the libfreenect2 sequence number and timestamp of the frame set besides its arrival
+// order and time on the host, so frames lost before they reach the host can be told apart. The sensor
+// timestamp is 32-bit and wraps after about 5 days; the capture thread sees every frame set, so it
+// unwraps it there. Only a jump from the top quarter of the range to the bottom one is a wrap; smaller
+// steps back (reordered frame sets, a fallback to another stream's clock) are kept as they are.
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener_impl.h>
+#include <libfreenect2/threading.h>
+
+#define CAPTURE_SLOTS 4             // Default ring size
+#define CAPTURE_POLL_US 500         // acquire() polling interval while the ring is empty
+#define CAPTURE_WAIT_MS 100         // Longest wait for a frame set before the capture thread checks stop()
+#define CAPTURE_SENSOR_TICK_US 100  // Unit of the libfreenect2 frame timestamp - 0.1 ms
+#define CAPTURE_WRAP_HIGH 0xC0000000u  // A step from above this to below CAPTURE_WRAP_LOW is a wrap
+#define CAPTURE_WRAP_LOW 0x40000000u
+
+enum CapturePolicy { CAPTURE_NEWEST, CAPTURE_QUEUE };
+
+enum { SLOT_FREE, SLOT_WRITING, SLOT_READY, SLOT_READING };
+
+struct CaptureFrame {
+  cv::Mat ir, depth;                // 512x424 CV_32FC1, as delivered by libfreenect2 (empty if not captured)
+  cv::Mat color;                    // 1920x1080 BGRX (BGR on older libfreenect2), empty if not captured
+  unsigned int sequence;            // Arrival order, from 1 (gaps are dropped frames)
+  int64 timestamp;                  // getTickCount() at arrival
+  uint32_t sensor_sequence;         // libfreenect2 sequence number (gaps are frames lost before the host)
+  int64 sensor_timestamp;           // Sensor clock, unwrapped - in microseconds
+  volatile int state;
+};
+
+class KinectCapture {
+public:
+  // types is a mask of libfreenect2::Frame::Ir, Depth and Color; every frame of a set shares the
+  // slot, so its sequence and timestamp match across streams
+  KinectCapture(libfreenect2::Freenect2Device *dev, unsigned int types, CapturePolicy policy = CAPTURE_NEWEST, int slots = CAPTURE_SLOTS)
+    : dev(dev), listener(types), policy(policy), n(std::max(slots, 2)), thread(0), running(0), captured_(0), dropped_(0), delivered_(0),
+      sensor_wraps(0), sensor_last(0) {
+    ring = new CaptureFrame[n];
+    for(int i = 0; i < n; i++) {
+      if(types & libfreenect2::Frame::Ir)
+        ring[i].ir.create(424, 512, CV_32FC1);
+      if(types & libfreenect2::Frame::Depth)
+        ring[i].depth.create(424, 512, CV_32FC1);
+      if(types & libfreenect2::Frame::Color)
+        ring[i].color.create(1080, 1920, CV_8UC4);
+      ring[i].sequence = 0;
+      ring[i].state = SLOT_FREE;
+    }
+    if(types & (libfreenect2::Frame::Ir | libfreenect2::Frame::Depth))
+      dev->setIrAndDepthFrameListener(&listener);
+    if(types & libfreenect2::Frame::Color)
+      dev->setColorFrameListener(&listener);
+  }
+
+  ~KinectCapture() {
+    stop();
+    delete [] ring;
+  }
+
+  // Starts the device and the capture thread
+  void start() {
+    if(running)
+      return;
+    running = 1;
+    dev->start();
+    thread = new libfreenect2::thread(&KinectCapture::run, this);
+  }
+
+  // Stops the capture thread (it exits within CAPTURE_WAIT_MS, even if the device stopped
+  // streaming) and the device
+  void stop() {
+    if(!running)
+      return;
+    running = 0;
+    thread->join();
+    delete thread;
+    thread = 0;
+    dev->stop();
+  }
+
+  // Next frame according to the policy; blocks while the ring is empty, NULL once stopped
+  CaptureFrame *acquire() {
+    CaptureFrame *best;
+    int i;
+
+    for(;;) {
+      best = 0;
+      for(i = 0; i < n; i++)
+        if(ring[i].state == SLOT_READY && (!best || (policy == CAPTURE_NEWEST ? ring[i].sequence > best->sequence : ring[i].sequence < best->sequence)))
+          best = &ring[i];
+
+      if(!best) {
+        if(!running)
+          return 0;
+        usleep(CAPTURE_POLL_US);
+        continue;
+      }
+      if(!__sync_bool_compare_and_swap(&best->state, SLOT_READY, SLOT_READING))
+        continue;
+
+      // Older frames will never be returned - claim them before checking, the producer may reuse them
+      if(policy == CAPTURE_NEWEST)
+        for(i = 0; i < n; i++)
+          if(&ring[i] != best && __sync_bool_compare_and_swap(&ring[i].state, SLOT_READY, SLOT_READING)) {
+            if(ring[i].sequence < best->sequence) {
+              ring[i].state = SLOT_FREE;
+              __sync_fetch_and_add(&dropped_, 1);
+            }
+            else
+              ring[i].state = SLOT_READY;
+          }
+
+      __sync_fetch_and_add(&delivered_, 1);
+      return best;
+    }
+  }
+
+  void release(CaptureFrame *frame) {
+    __sync_synchronize();
+    frame->state = SLOT_FREE;
+  }
+
+  unsigned int captured() const { return captured_; }
+  unsigned int dropped() const { return dropped_; }
+  unsigned int delivered() const { return delivered_; }
+
+private:
+  // Free slot, or the oldest unread one under CAPTURE_NEWEST; NULL drops the incoming frame
+  CaptureFrame *claim() {
+    CaptureFrame *oldest;
+    int i;
+
+    for(i = 0; i < n; i++)
+      if(__sync_bool_compare_and_swap(&ring[i].state, SLOT_FREE, SLOT_WRITING))
+        return &ring[i];
+    if(policy == CAPTURE_QUEUE)
+      return 0;
+
+    for(;;) {
+      oldest = 0;
+      for(i = 0; i < n; i++)
+        if(ring[i].state == SLOT_READY && (!oldest || ring[i].sequence < oldest->sequence))
+          oldest = &ring[i];
+      if(!oldest)
+        return 0;
+      if(__sync_bool_compare_and_swap(&oldest->state, SLOT_READY, SLOT_WRITING)) {
+        __sync_fetch_and_add(&dropped_, 1);
+        return oldest;
+      }
+    }
+  }
+
+  static void run(void *data) {
+    KinectCapture *capture = (KinectCapture *) data;
+    libfreenect2::FrameMap frames;
+    libfreenect2::Frame *frame, *sensor;
+    CaptureFrame *slot;
+    unsigned int sequence;
+    int64 timestamp;
+    uint32_t ticks;
+
+    while(capture->running) {
+      if(!capture->listener.waitForNewFrame(frames, CAPTURE_WAIT_MS))
+        continue;
+      timestamp = cv::getTickCount();
+      sequence = __sync_add_and_fetch(&capture->captured_, 1);
+
+      slot = capture->claim();
+      if(slot) {
+        // The sensor numbers come from the IR frame, else the depth or colour one
+        sensor = 0;
+        if(!slot->ir.empty() && (frame = frames[libfreenect2::Frame::Ir])) {
+          memcpy(slot->ir.data, frame->data, 512*424*sizeof(float));
+          sensor = frame;
+        }
+        if(!slot->depth.empty() && (frame = frames[libfreenect2::Frame::Depth])) {
+          memcpy(slot->depth.data, frame->data, 512*424*sizeof(float));
+          sensor = sensor ? sensor : frame;
+        }
+        if(!slot->color.empty() && (frame = frames[libfreenect2::Frame::Color])) {
+          slot->color.create(frame->height, frame->width, CV_8UC(frame->bytes_per_pixel));
+          memcpy(slot->color.data, frame->data, frame->width*frame->height*frame->bytes_per_pixel);
+          sensor = sensor ? sensor : frame;
+        }
+        slot->sequence = sequence;
+        slot->timestamp = timestamp;
+        slot->sensor_sequence = sensor ? sensor->sequence : sequence;
+        ticks = sensor ? sensor->timestamp : (uint32_t) (timestamp*1000000.0/CAPTURE_SENSOR_TICK_US/cv::getTickFrequency());
+        // A frame set from before the last wrap that arrives after it keeps the previous period
+        if(capture->sensor_last < CAPTURE_WRAP_LOW && ticks > CAPTURE_WRAP_HIGH && capture->sensor_wraps)
+          slot->sensor_timestamp = (((capture->sensor_wraps-1) << 32)+ticks)*CAPTURE_SENSOR_TICK_US;
+        else {
+          if(capture->sensor_last > CAPTURE_WRAP_HIGH && ticks < CAPTURE_WRAP_LOW)
+            capture->sensor_wraps++;
+          capture->sensor_last = ticks;
+          slot->sensor_timestamp = ((capture->sensor_wraps << 32)+ticks)*CAPTURE_SENSOR_TICK_US;
+        }
+        __sync_synchronize();
+        slot->state = SLOT_READY;
+      }
+      else
+        __sync_fetch_and_add(&capture->dropped_, 1);
+
+      capture->listener.release(frames);
+    }
+  }
+
+  libfreenect2::Freenect2Device *dev;
+  libfreenect2::SyncMultiFrameListener listener;
+  CapturePolicy policy;
+  CaptureFrame *ring;
+  int n;
+  libfreenect2::thread *thread;
+  volatile int running;
+  volatile unsigned int captured_, dropped_, delivered_;
+  int64 sensor_wraps;               // Capture thread only
+  uint32_t sensor_last;             // Sensor timestamp of the previous frame set - in ticks
+};
@@ -0,0 +1,139 @@
+// Lossless codec for 16-bit images (Kinect v2 depth in mm, or any CV_16UC1 frame)
+//
+// Each pixel is predicted from its left, upper and upper-left neighbours (median edge detector, as
+// in LOCO-I) and the residual is written with a Rice code whose parameter follows the running mean
+// of the residual magnitudes. Residuals too large for the code are escaped to their raw value.
+// Both directions are a single pass over the frame with no tables.
+
+#include <vector>
+#include <stdint.h>
+
+#include <opencv2/opencv.hpp>
+
+#define CODEC_MAX_UNARY 24          // Longest unary prefix; this many ones escape to a raw residual
+#define CODEC_ESCAPE_BITS 17        // Folded residual of two 16-bit values
+#define CODEC_RESET 64              // Residual statistics are halved every CODEC_RESET pixels
+
+// Median edge detector: a left, b up, c up-left
+static inline int codec_predict(int a, int b, int c) {
+  if(c >= std::max(a, b))
+    return std::min(a, b);
+  if(c <= std::min(a, b))
+    return std::max(a, b);
+  return a+b-c;
+}
+
+// Rice parameter for the mean magnitude a/n
+static inline int codec_parameter(int a, int n) {
+  int k = 0;
+  while((n << k) < a && k < 16)
+    k++;
+  return k;
+}
+
+// Appends the encoded frame to out
+static inline void depth_encode(const cv::Mat &image, std::vector<uchar> &out) {
+  uint64_t acc = 0;
+  int bits = 0, a = 4, n = 1;
+
+  out.reserve(out.size()+image.total());
+  for(int i = 0; i < image.rows; i++) {
+    const uint16_t *row = image.ptr<uint16_t>(i);
+    const uint16_t *up = i ? image.ptr<uint16_t>(i-1) : 0;
+    for(int j = 0; j < image.cols; j++) {
+      int prediction;
+      if(!up)
+        prediction = j ? row[j-1] : 0;
+      else if(!j)
+        prediction = up[0];
+      else
+        prediction = codec_predict(row[j-1], up[j], up[j-1]);
+
+      int e = row[j]-prediction;
+      uint32_t u = e >= 0 ? 2*e : -2*e-1;
+      int k = codec_parameter(a, n);
+      uint32_t q = u >> k;
+
+      // At most 25+16 or 24+17 bits are added, so the accumulator never holds more than 48
+      if(q < CODEC_MAX_UNARY) {
+        acc = (acc << (q+1)) | (((1u << q)-1) << 1);
+        acc = (acc << k) | (u & ((1u << k)-1));
+        bits += q+1+k;
+      }
+      else {
+        acc = (acc << CODEC_MAX_UNARY) | ((1u << CODEC_MAX_UNARY)-1);
+        acc = (acc << CODEC_ESCAPE_BITS) | u;
+        bits += CODEC_MAX_UNARY+CODEC_ESCAPE_BITS;
+      }
+      while(bits >= 8) {
+        bits -= 8;
+        out.push_back((uchar) (acc >> bits));
+      }
+
+      a += e >= 0 ? e : -e;
+      if(++n == CODEC_RESET) {
+        a >>= 1;
+        n >>= 1;
+      }
+    }
+  }
+  if(bits)
+    out.push_back((uchar) (acc << (8-bits)));
+}
+
+// Decodes a frame of image's size and type (CV_16UC1, allocated by the caller); false if the data
+// is shorter than the frame
+static inline bool depth_decode(const uchar *data, size_t size, cv::Mat &image) {
+  const uchar *p = data, *end = data+size;
+  uint64_t acc = 0;
+  int bits = 0, a = 4, n = 1;
+
+  for(int i = 0; i < image.rows; i++) {
+    uint16_t *row = image.ptr<uint16_t>(i);
+    const uint16_t *up = i ? image.ptr<uint16_t>(i-1) : 0;
+    for(int j = 0; j < image.cols; j++) {
+      // Top aligned; at least 57 bits, more than the longest code
+      while(bits <= 56) {
+        acc |= (uint64_t) (p < end ? *p : 0) << (56-bits);
+        p++;
+        bits += 8;
+      }
+
+      int k = codec_parameter(a, n);
+      int q = ~acc ? __builtin_clzll(~acc) : 64;
+      uint32_t u;
+      if(q < CODEC_MAX_UNARY) {
+        acc <<= q+1;
+        u = k ? (uint32_t) (acc >> (64-k)) : 0;
+        acc <<= k;
+        u |= (uint32_t) q << k;
+        bits -= q+1+k;
+      }
+      else {
+        acc <<= CODEC_MAX_UNARY;
+        u = (uint32_t) (acc >> (64-CODEC_ESCAPE_BITS));
+        acc <<= CODEC_ESCAPE_BITS;
+        bits -= CODEC_MAX_UNARY+CODEC_ESCAPE_BITS;
+      }
+
+      int prediction;
+      if(!up)
+        prediction = j ? row[j-1] : 0;
+      else if(!j)
+        prediction = up[0];
+      else
+        prediction = codec_predict(row[j-1], up[j], up[j-1]);
+      int e = (u & 1) ? -(int) ((u+1) >> 1) : (int) (u >> 1);
+      row[j] = (uint16_t) (prediction+e);
+
+      a += e >= 0 ? e : -e;
+      if(++n == CODEC_RESET) {
+        a >>= 1;
+        n >>= 1;
+      }
+    }
+  }
+
+  // Bits consumed must not go past the data
+  return (uint64_t) (p-data)*8-bits <= (uint64_t) size*8;
+}
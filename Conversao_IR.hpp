@@ -0,0 +1,74 @@
+// libfreenect2 IR (float amplitude, 0-65535) to the 8-bit image the NIR tools work on
+//
+// IR_GAIN_FIXED scales by IR_SCALE (one convertTo pass). IR_GAIN_AUTO converts through a lookup table
+// indexed by the amplitude in IR_BINS steps and builds the amplitude histogram in the same pass; the
+// table for the next frame maps the IR_AUTO_PERCENTILE amplitude to 255, so bright scenes do not clip.
+// The gain follows the scene smoothly and stays within [IR_AUTO_MIN_GAIN, IR_AUTO_MAX_GAIN].
+
+#include <opencv2/opencv.hpp>
+
+#define IR_SCALE (255.0/80000.0)    // Fixed gain
+#define IR_BIN_SHIFT 6              // Amplitude step of the table - 64
+#define IR_BINS 1024                // 65536 >> IR_BIN_SHIFT
+#define IR_AUTO_PERCENTILE 0.99     // Fraction of the pixels below 255 under auto gain
+#define IR_AUTO_SMOOTHING 0.1       // Fraction of the gain change applied per frame
+#define IR_AUTO_MIN_GAIN (255.0/65536.0)
+#define IR_AUTO_MAX_GAIN (255.0/4000.0)
+
+enum IrGain { IR_GAIN_FIXED, IR_GAIN_AUTO };
+
+class IrConverter {
+public:
+  IrConverter(IrGain mode = IR_GAIN_FIXED) : mode(mode) {
+    set_gain(IR_SCALE);
+  }
+
+  // out is reallocated only if its size or type differ
+  void convert(const cv::Mat &ir, cv::Mat &out) {
+    if(mode == IR_GAIN_FIXED) {
+      ir.convertTo(out, CV_8UC1, gain, 0);
+      return;
+    }
+
+    out.create(ir.rows, ir.cols, CV_8UC1);
+    memset(histogram, 0, sizeof(histogram));
+    for(int i = 0; i < ir.rows; i++) {
+      const float *src = ir.ptr<float>(i);
+      uchar *dst = out.ptr<uchar>(i);
+      for(int j = 0; j < ir.cols; j++) {
+        int b = std::min((int) src[j] >> IR_BIN_SHIFT, IR_BINS-1);
+        histogram[b]++;
+        dst[j] = lut[b];
+      }
+    }
+    adapt(ir.total());
+  }
+
+  double current_gain() const { return gain; }
+
+private:
+  void set_gain(double g) {
+    gain = g;
+    for(int b = 0; b < IR_BINS; b++)
+      lut[b] = cv::saturate_cast<uchar>(((b << IR_BIN_SHIFT)+(1 << (IR_BIN_SHIFT-1)))*gain);
+  }
+
+  // Gain for the next frame from the histogram of this one
+  void adapt(size_t pixels) {
+    size_t count = 0, target = (size_t) (IR_AUTO_PERCENTILE*pixels);
+    int b;
+
+    for(b = 0; b < IR_BINS-1; b++) {
+      count += histogram[b];
+      if(count >= target)
+        break;
+    }
+    double wanted = std::min(std::max(255.0/((b+1) << IR_BIN_SHIFT), IR_AUTO_MIN_GAIN), IR_AUTO_MAX_GAIN);
+    set_gain(gain+IR_AUTO_SMOOTHING*(wanted-gain));
+  }
+
+  IrGain mode;
+  double gain;
+  uchar lut[IR_BINS];
+  unsigned int histogram[IR_BINS];
+};
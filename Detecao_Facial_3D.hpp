@@ -0,0 +1,594 @@
+// 3D face detection on Kinect v2 depth frames (libfreenect2 depth in mm, used in place)
+// Define SHOW_PROJECTION before including to display the projection of each pose
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+using namespace std;
+
+const string PATH_CASCADE_FACE = "/home/matheusm/Cascades/ALL_Spring2003_3D.xml";
+const string PATH_CACHE = "/var/tmp";
+
+// Cascade of the detector, shared by every file of the program
+inline string &face_cascade_path() {
+  static string path = PATH_CASCADE_FACE;
+  return path;
+}
+static string &cascade_path = face_cascade_path();
+
+// Image parameters
+#define WIDTH 512             // Input image width
+#define HEIGHT 424              // Input image height
+#define SIZE 217088             // Input image size
+// Calibration parameters
+#define DEPTH_RANGE 2048          // Range of depth values [0,DEPTH_RANGE[
+#define DEPTH_FX 5.8498272251689014e+02   // Scaling factor for the x axis
+#define DEPTH_FY 5.8509835924680374e+02   // Scaling factor for the y axis
+#define DEPTH_CX 3.1252165122981484e+02   // Camera center for the x axis
+#define DEPTH_CY 2.3821622578866226e+02   // Camera center for the y axis
+#define DEPTH_Z1 1.1863           // Disparity to mm - 1st parameter
+#define DEPTH_Z2 2842.5           // Disparity to mm - 2nd parameter
+#define DEPTH_Z3 123.6            // Disparity to mm - 3rd parameter
+#define DEPTH_Z4 95.45454545        // Disparity to mm - 4th parameter (750*RESOLUTION)
+#define DEPTH_LTHRESHOLD 400        // Minimum disparity value
+#define DEPTH_CTHRESHOLD 675          // Maximum disparity value
+#define DEPTH_THRESHOLD 875         // Maximum disparity value
+// Detection parameters
+#define X_WIDTH 1800.0            // Orthogonal projection width - in mm
+#define Y_WIDTH 1600.0            // Orthogonal projection height - in mm
+#define RESOLUTION 0.127272727        // Resolution in pixels per mm  0.127272727 
+#define FACE_SIZE 21            // Face size - 165*RESOLUTION
+#define FACE_HALF_SIZE 10         // (165*RESOLUTION)/2
+// Normalization parameters
+#define MODEL_WIDTH 48.0
+#define MODEL_HEIGHT_1 56.0
+#define MODEL_HEIGHT_2 16.0
+#define MODEL_RESOLUTION 1.0
+#define MAX_DEPTH_VALUE 5000
+#define OUTLIER_THRESHOLD 15.0
+#define OUTLIER_SQUARED_THRESHOLD 225.0
+#define MAX_ICP_ITERATIONS 200
+
+// Compute rotation matrix and its inverse matrix
+static inline void computeRotationMatrix(double matrix[3][3], double imatrix[3][3], double aX, double aY, double aZ) {
+  double cosX, cosY, cosZ, sinX, sinY, sinZ, d;
+
+  cosX = cos(aX);
+  cosY = cos(aY);
+  cosZ = cos(aZ);
+  sinX = sin(aX);
+  sinY = sin(aY);
+  sinZ = sin(aZ);
+
+  matrix[0][0] = cosZ*cosY+sinZ*sinX*sinY;
+  matrix[0][1] = sinZ*cosY-cosZ*sinX*sinY;
+  matrix[0][2] = cosX*sinY;
+  matrix[1][0] = -sinZ*cosX;
+  matrix[1][1] = cosZ*cosX;
+  matrix[1][2] = sinX;
+  matrix[2][0] = sinZ*sinX*cosY-cosZ*sinY;
+  matrix[2][1] = -cosZ*sinX*cosY-sinZ*sinY;
+  matrix[2][2] = cosX*cosY;
+
+  d = matrix[0][0]*(matrix[2][2]*matrix[1][1]-matrix[2][1]*matrix[1][2])-matrix[1][0]*(matrix[2][2]*matrix[0][1]-matrix[2][1]*matrix[0][2])+matrix[2][0]*(matrix[1][2]*matrix[0][1]-matrix[1][1]*matrix[0][2]);
+
+  imatrix[0][0] = (matrix[2][2]*matrix[1][1]-matrix[2][1]*matrix[1][2])/d;
+  imatrix[0][1] = -(matrix[2][2]*matrix[0][1]-matrix[2][1]*matrix[0][2])/d;
+  imatrix[0][2] = (matrix[1][2]*matrix[0][1]-matrix[1][1]*matrix[0][2])/d;
+  imatrix[1][0] = -(matrix[2][2]*matrix[1][0]-matrix[2][0]*matrix[1][2])/d;
+  imatrix[1][1] = (matrix[2][2]*matrix[0][0]-matrix[2][0]*matrix[0][2])/d;
+  imatrix[1][2] = -(matrix[1][2]*matrix[0][0]-matrix[1][0]*matrix[0][2])/d;
+  imatrix[2][0] = (matrix[2][1]*matrix[1][0]-matrix[2][0]*matrix[1][1])/d;
+  imatrix[2][1] = -(matrix[2][1]*matrix[0][0]-matrix[2][0]*matrix[0][1])/d;
+  imatrix[2][2] = (matrix[1][1]*matrix[0][0]-matrix[1][0]*matrix[0][1])/d;
+}
+
+static inline void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3], double background) {
+  static int flag = 1, height, width, size, cx, cy, *li, *lj, *lc;
+  int i, j, k, l, c, t;
+  double d;
+
+  if(flag) {
+    flag = 0;
+
+    height = p->height;
+    width = p->width;
+    size = height*width;
+
+    li = (int *) malloc(3*size*sizeof(int));
+    lj = li+size;
+    lc = lj+size;
+
+    cx = width/2;
+    cy = height/2;
+  }
+  // Compute projection
+  cvSet(p, cvRealScalar(-DBL_MAX), NULL);
+  cvSet(m, cvRealScalar(0), NULL);
+  for(i=0; i < n; i++) {
+    j = cy-cvRound(xyz[i].x*matrix[1][0]+xyz[i].y*matrix[1][1]+xyz[i].z*matrix[1][2]);
+    k = cx+cvRound(xyz[i].x*matrix[0][0]+xyz[i].y*matrix[0][1]+xyz[i].z*matrix[0][2]);
+    d = xyz[i].x*matrix[2][0]+xyz[i].y*matrix[2][1]+xyz[i].z*matrix[2][2];
+
+    if(j >= 0 && k >= 0 && j < height && k < width && d > CV_IMAGE_ELEM(p, double, j, k)) {
+      CV_IMAGE_ELEM(p, double, j, k) = d;
+      CV_IMAGE_ELEM(m, uchar, j, k) = 1;
+    }
+  }
+
+  // Hole filling
+  k=l=0;
+  for(i=1; i < height-1; i++)
+    for(j=1; j < width-1; j++)
+      if(!CV_IMAGE_ELEM(m, uchar, i, j) && (CV_IMAGE_ELEM(m, uchar, i, j-1) || CV_IMAGE_ELEM(m, uchar, i, j+1) || CV_IMAGE_ELEM(m, uchar, i-1, j) || CV_IMAGE_ELEM(m, uchar, i+1, j))) {
+        li[l] = i;
+        lj[l] = j;
+        lc[l] = 1;
+        l++;
+      }
+
+  while(k < l) {
+    i = li[k];
+    j = lj[k];
+    c = lc[k];
+    if(!CV_IMAGE_ELEM(m, uchar, i, j) && i > 0 && i < height-1 && j > 0 && j < width-1 && c < FACE_HALF_SIZE) {
+      CV_IMAGE_ELEM(m, uchar, i, j) = c+1;
+      t = 0;
+      d = 0.0f;
+      if(CV_IMAGE_ELEM(m, uchar, i, j-1) && CV_IMAGE_ELEM(m, uchar, i, j-1) <= c) {
+        t++;
+        d += CV_IMAGE_ELEM(p, double, i, j-1);
+      }
+      else {
+        li[l] = i;
+        lj[l] = j-1;
+        lc[l] = c+1;
+        l++;
+      }
+      if(CV_IMAGE_ELEM(m, uchar, i, j+1) && CV_IMAGE_ELEM(m, uchar, i, j+1) <= c) {
+        t++;
+        d += CV_IMAGE_ELEM(p, double, i, j+1);
+      }
+      else {
+        li[l] = i;
+        lj[l] = j+1;
+        lc[l] = c+1;
+        l++;
+      }
+      if(CV_IMAGE_ELEM(m, uchar, i-1, j) && CV_IMAGE_ELEM(m, uchar, i-1, j) <= c) {
+        t++;
+        d += CV_IMAGE_ELEM(p, double, i-1, j);
+      }
+      else {
+        li[l] = i-1;
+        lj[l] = j;
+        lc[l] = c+1;
+        l++;
+      }
+      if(CV_IMAGE_ELEM(m, uchar, i+1, j) && CV_IMAGE_ELEM(m, uchar, i+1, j) <= c) {
+        t++;
+        d += CV_IMAGE_ELEM(p, double, i+1, j);
+      }
+      else {
+        li[l] = i+1;
+        lj[l] = j;
+        lc[l] = c+1;
+        l++;
+      }
+      CV_IMAGE_ELEM(p, double, i, j) = d/(double)t;
+    }
+    k++;
+  }
+  // Final adjustments
+  for(i=0; i < height; i++)
+    for(j=0; j < width; j++) {
+      if(CV_IMAGE_ELEM(p, double, i, j) == -DBL_MAX)
+        CV_IMAGE_ELEM(p, double, i, j) = background;
+      if(CV_IMAGE_ELEM(m, uchar, i, j))
+        CV_IMAGE_ELEM(m, uchar, i, j) = 1;
+    }
+}
+
+// IR camera parameters, one set per program however many files include this header; the names
+// below refer to it
+struct IrIntrinsics {
+  float fx, fy, cx, cy, k1, k2, p1, p2, k3;
+};
+
+inline IrIntrinsics &ir_intrinsics() {
+  static IrIntrinsics intrinsics;
+  return intrinsics;
+}
+
+static float &fx = ir_intrinsics().fx;
+static float &fy = ir_intrinsics().fy;
+static float &cx = ir_intrinsics().cx;
+static float &cy = ir_intrinsics().cy;
+static float &k1 = ir_intrinsics().k1;
+static float &k2 = ir_intrinsics().k2;
+static float &p1 = ir_intrinsics().p1;
+static float &p2 = ir_intrinsics().p2;
+static float &k3 = ir_intrinsics().k3;
+
+// Pixel of a point in mm (z is the negated depth, as in the cloud)
+static inline void xyz2depth(CvPoint3D64f *pt, int *i, int *j, int *s, const Mat &xycords) {
+  float x, y;
+  x = -(fx * pt->x)/pt->z + cx;
+  y = (fy * pt->y)/pt->z + cy;
+  *s = 65.0;
+  int p;
+  for(p = 0; p < 217088; p++) {
+    cv::Vec2f xy = xycords.at<cv::Vec2f>(0, p);
+    if(fabs(x - xy[1]) < 0.9 && fabs(y - xy[0]) < 0.9)
+      break;
+  }
+  if(p < 512) {
+    *i = 0;
+    *j = p;
+  }
+  else {
+    *i = p / 512;
+    *j = p % 512;
+  }
+  
+  /*cv::Vec2f xy = xycords.at<cv::Vec2f>(0, i);
+  x = xy[1]; y = xy[0];
+  xyz[i].z = -(static_cast<float>(*ptr)) * (1000.0f); // Converte metros pra mm
+  xyz[i].x = -(x - cx) * xyz[i].z / fx;
+  xyz[i].y = (y - cy) * xyz[i].z / fy;*/
+}
+
+// depth_image is the CV_32FC1 libfreenect2 depth in mm (0 where there is no return); it is only read.
+// The cloud is scaled by RESOLUTION, so one unit is one projection pixel, as in the v1 detector
+static inline vector<Vec4i> face_detection_(const Mat &depth_image, int minX, int maxX, int minY, int maxY, int minZ, int maxZ, const Mat &xycords) {
+  
+  static CvPoint3D64f *xyz, *list, *clist;
+  CvPoint3D64f avg;
+  
+  const float* ptr = (const float*) (depth_image.data);
+  const cv::Vec2f* xy = xycords.ptr<cv::Vec2f>(0);
+  const cv::Vec2f* ray = xycords.rows > 1 ? xycords.ptr<cv::Vec2f>(1) : 0;
+  static CvHaarClassifierCascade *face_cascade;
+  float x = 0.0f, y = 0.0f;
+  uint pixel_count = depth_image.rows * depth_image.cols, n_points = 0;
+  double menorX = 999999.0, menorY = 999999.0, menor = 999999.0;
+  double maiorX = 0.0, maiorY = 0.0, maior = 0.0;
+  static IplImage *p, *m, *sum, *sqsum, *tiltedsum, *msum, *sumint, *tiltedsumint;;
+  static int width, height, CX, CY, flag = 1;
+  double matrix[3][3], imatrix[3][3], background, X, Y, Z;
+  
+  if(flag)
+    xyz = (CvPoint3D64f *) malloc(SIZE*sizeof(CvPoint3D64f));
+  // Pixels without a return are left out of the cloud
+  for (uint i = 0; i < pixel_count; ++i, ++ptr)
+  {
+      if(*ptr <= 0.0f)
+        continue;
+      CvPoint3D64f &pt = xyz[n_points++];
+      pt.z = -(*ptr) * RESOLUTION;
+      if(ray) {
+        pt.x = ray[i][0] * pt.z;
+        pt.y = ray[i][1] * pt.z;
+      }
+      else {
+        x = xy[i][1]; y = xy[i][0];
+        pt.x = -(x - cx) * pt.z / fx;
+        pt.y = (y - cy) * pt.z / fy;
+      }
+      if(pt.z < menor)
+        menor = pt.z;
+  }
+  background = menor + 100.0*RESOLUTION;
+
+  if(flag) {
+      flag = 0;
+
+      width = (int)(X_WIDTH*RESOLUTION);
+      height = (int)(X_WIDTH*RESOLUTION);
+
+      CX = width/2;
+      CY = height/2;
+
+      p = cvCreateImage(cvSize(width, height), IPL_DEPTH_64F, 1);
+      m = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+
+      face_cascade = (CvHaarClassifierCascade *) cvLoad(cascade_path.c_str(), 0, 0, 0);
+      sum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+      sqsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+      tiltedsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+      sumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
+      tiltedsumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
+      msum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
+
+      list = (CvPoint3D64f *) malloc(2000*sizeof(CvPoint3D64f));
+      clist = list+1000;
+  }
+
+  int i, j, k = 0, l, n, aX, aY, aZ;
+
+  Mat colored;
+  for(aX=minX, k=0; aX <= maxX; aX += 10) {
+    for(aY=minY; aY <= maxY; aY += 10) {
+      for(aZ=minZ; aZ <= maxZ; aZ += 10) {
+        
+        if(aX+aY+aZ > 30)
+          continue;
+        
+        computeRotationMatrix(matrix, imatrix, aX*0.017453293, aY*0.017453293, aZ*0.017453293);
+        compute_projection(p, m, xyz, n_points, matrix, background);
+        
+        menor = 999999.0; 
+        for(i = 0; i < width; i++) {
+          for(j = 0; j < height; j++) {
+            double x = CV_IMAGE_ELEM(p, double, i, j);
+            if(x > maior)
+              maior = x;
+            if(x < menor && x != 0)
+              menor = x;
+          }
+        }
+        
+        double a, b;
+        a = 255/(maior-menor);
+        b = 1 - (menor * a);
+        for(i = 0; i < width; i++) {
+          for(j = 0; j < height; j++) {
+            x = CV_IMAGE_ELEM(p, double, i, j);
+            if(x != 0)
+              CV_IMAGE_ELEM(p, double, i, j) = (x * a) + b;
+          }
+        }
+        #ifdef SHOW_PROJECTION
+        Mat projecao= cv::cvarrToMat(p); 
+        
+        Mat1b x(projecao.rows, projecao.cols);
+        for(i = 0; i < projecao.rows; i++)
+          for(j = 0; j < projecao.cols; j++) 
+            x.at<uint8_t>(i, j) = projecao.at<double>(i, j);
+        
+        applyColorMap(x, colored, COLORMAP_JET);
+        
+        #endif
+
+        cvIntegral(p, sum, sqsum, tiltedsum);
+        cvIntegral(m, msum, NULL, NULL);
+        
+        for(i=0; i < height+1; i++)
+          for(j=0; j < width+1; j++) {
+            CV_IMAGE_ELEM(sumint, int, i, j) = CV_IMAGE_ELEM(sum, double, i, j);
+            CV_IMAGE_ELEM(tiltedsumint, int, i, j) = CV_IMAGE_ELEM(tiltedsum, double, i, j);
+          }
+
+        cvSetImagesForHaarClassifierCascade(face_cascade, sumint, sqsum, tiltedsumint, 1.0);
+
+        for(i=0; i < height-20; i++)
+          for(j=0; j < width-20; j++)
+            if(CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j)+CV_IMAGE_ELEM(msum, int, i, j) == 441)
+              if(cvRunHaarClassifierCascade(face_cascade, cvPoint(j,i), 0) > 0) {
+                #ifdef SHOW_PROJECTION
+                rectangle(colored, Point(j, i), Point(j+21, i+21), CV_RGB(0,255,0));
+                #endif
+                // Back to mm; the projection was stretched by a and b above
+                X = (j+FACE_HALF_SIZE-CX)/RESOLUTION;
+                Y = (CY-i-FACE_HALF_SIZE)/RESOLUTION;
+                Z = ((CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE-5)+CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE-5))/121.0-b)/a/RESOLUTION;
+                
+                list[k].x = X*imatrix[0][0]+Y*imatrix[0][1]+Z*imatrix[0][2];
+                list[k].y = X*imatrix[1][0]+Y*imatrix[1][1]+Z*imatrix[1][2];
+                list[k].z = X*imatrix[2][0]+Y*imatrix[2][1]+Z*imatrix[2][2];
+                
+                k++;
+        }
+      }
+    }
+  }
+  #ifdef SHOW_PROJECTION
+  cv::imshow("Imagem de Projecao", colored);
+  #endif
+
+  // Merge multiple detections
+  vector<Vec4i> r;
+  Vec4i tmp;
+
+  while(k > 0) {
+
+    avg.x = clist[0].x = list[0].x;
+    avg.y = clist[0].y = list[0].y;
+    avg.z = clist[0].z = list[0].z;
+    list[0].x = DBL_MAX;
+    
+    j=1;
+    
+    for(l=0; l < j; l++)
+      for(i=1; i < k; i++)
+        if(list[i].x != DBL_MAX) {
+          X = sqrt(pow(list[i].x-clist[l].x, 2.0)+pow(list[i].y-clist[l].y, 2.0)+pow(list[i].z-clist[l].z, 2.0));
+          if(X < 50.0) {
+            
+            avg.x += clist[j].x = list[i].x;
+            avg.y += clist[j].y = list[i].y;
+            avg.z += clist[j].z = list[i].z;
+            list[i].x = DBL_MAX;
+            
+            j++;
+          }
+        }
+
+    avg.x /= j;
+    avg.y /= j;
+    avg.z /= j;
+    
+    xyz2depth(&avg, &tmp[1], &tmp[0], &tmp[2], xycords);
+    
+    tmp[3] = j;
+    r.push_back(tmp);
+
+    j=0;
+    
+    for(i=1; i < k; i++)
+      if(list[i].x != DBL_MAX) {
+        list[j].x = list[i].x;
+        list[j].y = list[i].y;
+        list[j].z = list[i].z;
+        j++;
+      }
+    k=j;
+    
+  }
+  return r;
+}
+
+static inline vector<Vec4i> face_detection(const Mat &depth, const Mat &xycords) {
+  return face_detection_(depth, 0, 30, -20, 20, 0, 0, xycords);
+}
+
+static inline vector<Vec4i> frontal_face_detection(const Mat &depth, const Mat &xycords) {
+  return face_detection_(depth, 0, 0, 0, 0, 0, 0, xycords);
+}
+
+// Undistorted pixel coordinates (row, column) of the IR camera
+static inline Mat undistorted_coordinates() {
+  int width = 512;
+  int height = 424;
+
+  cv::Mat cv_img_cords = cv::Mat(1, width*height, CV_32FC2);
+  Mat cv_img_corrected_cords;
+  for (int r = 0; r < height; ++r) {
+      for (int c = 0; c < width; ++c) {
+          cv_img_cords.at<cv::Vec2f>(0, r*width + c) = cv::Vec2f((float)r, (float)c);
+      }
+  }
+
+  cv::Mat k = cv::Mat::eye(3, 3, CV_32F);
+  k.at<float>(0,0) = fx;
+  k.at<float>(1,1) = fy;
+  k.at<float>(0,2) = cx;
+  k.at<float>(1,2) = cy;
+
+  cv::Mat dist_coeffs = cv::Mat::zeros(1, 8, CV_32F);
+  dist_coeffs.at<float>(0,0) = k1;
+  dist_coeffs.at<float>(0,1) = k2;
+  dist_coeffs.at<float>(0,2) = p1;
+  dist_coeffs.at<float>(0,3) = p2;
+  dist_coeffs.at<float>(0,4) = k3;
+
+  cv::Mat new_camera_matrix = cv::getOptimalNewCameraMatrix(k, dist_coeffs, cv::Size2i(height,width), 0.0);
+
+  cv::undistortPoints(cv_img_cords, cv_img_corrected_cords, k, dist_coeffs, cv::noArray(), new_camera_matrix);
+
+  return cv_img_corrected_cords;
+}
+
+// IR camera parameters saved from a live device, so recorded frames can be processed without it
+static inline bool save_intrinsics(const string &filename) {
+  FileStorage fs(filename, FileStorage::WRITE);
+  if(!fs.isOpened())
+    return false;
+
+  fs << "fx" << fx << "fy" << fy << "cx" << cx << "cy" << cy;
+  fs << "k1" << k1 << "k2" << k2 << "p1" << p1 << "p2" << p2 << "k3" << k3;
+  return true;
+}
+
+static inline bool load_intrinsics(const string &filename) {
+  FileStorage fs(filename, FileStorage::READ);
+  if(!fs.isOpened())
+    return false;
+
+  fs["fx"] >> fx;
+  fs["fy"] >> fy;
+  fs["cx"] >> cx;
+  fs["cy"] >> cy;
+  fs["k1"] >> k1;
+  fs["k2"] >> k2;
+  fs["p1"] >> p1;
+  fs["p2"] >> p2;
+  fs["k3"] >> k3;
+  return true;
+}
+
+// Undistortion cache: one file per device and intrinsics, holding the undistorted coordinates
+// (row 0, as undistorted_coordinates()) and the pixel rays (row 1, x and y per mm of z)
+#define CACHE_MAGIC "KV2UND01"
+
+struct CoordinateCache {
+  char magic[8];
+  char serial[32];
+  float intrinsics[9];              // fx fy cx cy k1 k2 p1 p2 k3
+  int32_t width, height;
+};
+
+static inline void cache_key(CoordinateCache *header, const string &serial) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, CACHE_MAGIC, 8);
+  strncpy(header->serial, serial.c_str(), sizeof(header->serial)-1);
+  header->intrinsics[0] = fx; header->intrinsics[1] = fy;
+  header->intrinsics[2] = cx; header->intrinsics[3] = cy;
+  header->intrinsics[4] = k1; header->intrinsics[5] = k2;
+  header->intrinsics[6] = p1; header->intrinsics[7] = p2;
+  header->intrinsics[8] = k3;
+  header->width = WIDTH;
+  header->height = HEIGHT;
+}
+
+// Undistorted coordinates and rays for the current intrinsics. The table is mapped read-only from
+// dir, so every process on the same device shares one copy; it is built and written on the first run
+// (or when the intrinsics change). The mapping lives until the process exits.
+static inline Mat cached_undistorted_coordinates(const string &serial, const string &dir = PATH_CACHE) {
+  CoordinateCache key;
+  struct stat st;
+  size_t size = sizeof(CoordinateCache) + 2*SIZE*sizeof(cv::Vec2f);
+  uint32_t hash = 2166136261u;
+  int fd;
+
+  cache_key(&key, serial);
+  for(size_t b = 0; b < sizeof(key); b++)
+    hash = (hash ^ ((const uchar *) &key)[b]) * 16777619u;
+  string path = dir + "/xycords_" + (serial.empty() ? string("default") : serial) + format("_%08x.bin", hash);
+
+  fd = open(path.c_str(), O_RDONLY);
+  if(fd >= 0) {
+    void *data = MAP_FAILED;
+    if(!fstat(fd, &st) && (size_t) st.st_size == size)
+      data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data != MAP_FAILED) {
+      if(!memcmp(data, &key, sizeof(key)))
+        return Mat(2, SIZE, CV_32FC2, (uchar *) data + sizeof(CoordinateCache));
+      munmap(data, size);
+    }
+  }
+
+  Mat table(2, SIZE, CV_32FC2);
+  Mat coordinates = table.row(0);
+  undistorted_coordinates().copyTo(coordinates);
+  const cv::Vec2f* xy = table.ptr<cv::Vec2f>(0);
+  cv::Vec2f* ray = table.ptr<cv::Vec2f>(1);
+  for(int i = 0; i < SIZE; i++) {
+    ray[i][0] = -(xy[i][1] - cx) / fx;
+    ray[i][1] = (xy[i][0] - cy) / fy;
+  }
+
+  // Written under a temporary name and renamed, so concurrent launches never map a partial file
+  string tmp = path + format(".%d", (int) getpid());
+  fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    cout << "could not write undistortion cache " << path << endl;
+    return table;
+  }
+  bool ok = write(fd, &key, sizeof(key)) == (ssize_t) sizeof(key) &&
+            write(fd, table.data, size - sizeof(key)) == (ssize_t) (size - sizeof(key));
+  close(fd);
+  if(!ok || rename(tmp.c_str(), path.c_str()))
+    unlink(tmp.c_str());
+  return table;
+}
@@ -0,0 +1,196 @@
+// Headless 3D face detection over recorded Kinect v2 depth frames
+//
+// Usage: Detecao_Facial_3D_Offline <intrinsics.yml> <frames.txt> <output.txt> [frontal] [cascade.xml] [truth.csv]
+//
+// frames.txt has one frame per line: a PGM image (16-bit in mm, or 8-bit with 0..255 spanning
+// 0..4500 mm like input.pgm) or a raw dump of the libfreenect2 float depth frame (512x424, mm).
+// intrinsics.yml is written by Detecao_Facial_3D when given a .yml argument.
+// Each output line is "frame time_ms n x y s count ..." with one (x y s count) per face.
+//
+// With the truth.csv of Deteccao_3D_Mauricio/synthetic v2 it is a regression check: every face whose
+// pose is among the searched ones must be found within TRUTH_TOLERANCE pixels of its centre, or the
+// program exits with 1. E.g.
+//   synthetic v2 50 /tmp/v2
+//   Detecao_Facial_3D_Offline /tmp/v2/intrinsics.yml /tmp/v2/frames.txt /tmp/v2/out.txt /tmp/v2/truth.csv
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+#include <opencv2/opencv.hpp>
+
+#include "Detecao_Facial_3D.hpp"
+
+using namespace cv;
+using namespace std;
+
+#define TRUTH_TOLERANCE 20          // Largest distance from the true face centre - in pixels
+#define TRUTH_POSE_MARGIN 5         // Poses this far outside the searched ones are found too - in degrees
+
+struct Truth {
+  bool present;
+  Point2f centre;
+  int aX, aY, aZ;
+};
+
+// truth.csv lines are "frame;x;y;aX;aY;aZ", or just "frame" when there is no face
+bool read_truth(const string &path, map<string, Truth> &truth) {
+  ifstream file(path.c_str());
+  string line, name, field;
+
+  if(!file)
+    return false;
+  while(getline(file, line)) {
+    stringstream liness(line);
+    Truth t;
+    double v[5];
+    int n = 0;
+
+    getline(liness, name, ';');
+    while(n < 5 && getline(liness, field, ';'))
+      v[n++] = atof(field.c_str());
+    t.present = n == 5;
+    t.centre = Point2f(n == 5 ? v[0] : 0, n == 5 ? v[1] : 0);
+    t.aX = n == 5 ? v[2] : 0;
+    t.aY = n == 5 ? v[3] : 0;
+    t.aZ = n == 5 ? v[4] : 0;
+    if(!name.empty())
+      truth[name] = t;
+  }
+  return true;
+}
+
+// Poses of face_detection (aX 0..30, aY -20..20, aZ 0, sum at most 30) or frontal_face_detection
+bool searched_pose(const Truth &t, bool frontal) {
+  int m = TRUTH_POSE_MARGIN;
+
+  if(abs(t.aZ) > m)
+    return false;
+  if(frontal)
+    return abs(t.aX) <= m && abs(t.aY) <= m;
+  return t.aX >= -m && t.aX <= 30+m && abs(t.aY) <= 20+m && t.aX+t.aY <= 30+m;
+}
+
+// Depth as the detector expects it - float, in mm
+bool read_depth(const string &path, Mat &depth) {
+  if(path.size() > 4 && path.compare(path.size()-4, 4, ".pgm") == 0) {
+    Mat img = imread(path, CV_LOAD_IMAGE_ANYDEPTH);
+    if(img.empty() || img.rows != HEIGHT || img.cols != WIDTH)
+      return false;
+
+    if(img.depth() == CV_16U)
+      img.convertTo(depth, CV_32F);
+    else
+      img.convertTo(depth, CV_32F, 4500.0/255.0);
+    return true;
+  }
+
+  ifstream file(path.c_str(), ios::binary);
+  if(!file)
+    return false;
+
+  depth.create(HEIGHT, WIDTH, CV_32FC1);
+  return (bool) file.read((char *) depth.data, SIZE*sizeof(float));
+}
+
+int main(int argc, char *argv[]) {
+  bool frontal = false;
+  int frames = 0, faces_found = 0, checked = 0, missed = 0, false_faces = 0;
+  double t, total = 0.0, tmin = DBL_MAX, tmax = 0.0;
+  string path;
+  vector<Vec4i> faces;
+  map<string, Truth> truth;
+  Mat depth;
+
+  if(argc < 4) {
+    cout << "Usage: " << argv[0] << " <intrinsics.yml> <frames.txt> <output.txt> [frontal] [cascade.xml] [truth.csv]" << endl;
+    return -1;
+  }
+
+  for(int i = 4; i < argc; i++) {
+    string arg(argv[i]);
+    if(arg == "frontal")
+      frontal = true;
+    else if(arg.find(".xml") != string::npos)
+      cascade_path = arg;
+    else if(arg.find(".csv") != string::npos) {
+      if(!read_truth(arg, truth)) {
+        cout << "Could not read " << arg << endl;
+        return -1;
+      }
+    }
+    else
+      cout << "Unknown argument: " << arg << endl;
+  }
+
+  if(!load_intrinsics(argv[1])) {
+    cout << "Could not read intrinsics from " << argv[1] << endl;
+    return -1;
+  }
+
+  ifstream list(argv[2]);
+  ofstream output(argv[3]);
+  if(!list || !output) {
+    cout << "Could not open " << argv[2] << " or write to " << argv[3] << endl;
+    return -1;
+  }
+
+  Mat xycords = cached_undistorted_coordinates("offline");
+
+  while(getline(list, path)) {
+    if(path.empty())
+      continue;
+
+    if(!read_depth(path, depth)) {
+      cerr << path << ": not a " << WIDTH << "x" << HEIGHT << " depth frame" << endl;
+      continue;
+    }
+
+    // Detection only - reading and conversion are not timed
+    t = (double) getTickCount();
+    faces = frontal ? frontal_face_detection(depth, xycords) : face_detection(depth, xycords);
+    t = ((double) getTickCount()-t)*1000.0/getTickFrequency();
+
+    output << path << " " << t << " " << faces.size();
+    for(int i = 0; i < faces.size(); i++)
+      output << " " << faces[i][0] << " " << faces[i][1] << " " << faces[i][2] << " " << faces[i][3];
+    output << endl;
+
+    map<string, Truth>::iterator known = truth.find(path);
+    if(known != truth.end()) {
+      const Truth &t = known->second;
+      int near = 0;
+      for(int i = 0; i < faces.size(); i++)
+        if(hypot(faces[i][0]-t.centre.x, faces[i][1]-t.centre.y) <= TRUTH_TOLERANCE)
+          near++;
+      false_faces += faces.size()-min(near, 1);
+      if(t.present && searched_pose(t, frontal)) {
+        checked++;
+        if(!near) {
+          missed++;
+          cerr << path << ": face at " << t.centre.x << " " << t.centre.y << " (pose " << t.aX << " " << t.aY << " " << t.aZ << ") not found" << endl;
+        }
+      }
+    }
+
+    frames++;
+    faces_found += faces.size();
+    total += t;
+    tmin = min(tmin, t);
+    tmax = max(tmax, t);
+  }
+
+  if(frames) {
+    cout << "Frames: " << frames << endl;
+    cout << "Faces: " << faces_found << endl;
+    cout << "Time per frame (ms): mean " << total/frames << ", min " << tmin << ", max " << tmax << endl;
+  }
+  if(!truth.empty()) {
+    cout << "Truth: " << checked-missed << " of " << checked << " faces in searched poses found, " << false_faces << " false detections" << endl;
+    if(missed)
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Train an LBP depth cascade from annotated 16-bit depth frames
+# Usage: Script_Train_LBP.sh <list.csv> <output dir>
+mkdir -p $2/classifier
+./samples $1 $2 || exit 1
+cd $2
+
+NUMPOS=`wc -l < positives.dat`
+echo 'Criando positives samples'
+opencv_createsamples -info positives.dat -vec samples.vec -num $NUMPOS -w 21 -h 21
+
+echo 'Treinando classificador'
+opencv_traincascade -data classifier -vec samples.vec -bg negatives.txt\
+  -numStages 20 -minHitRate 0.999 -maxFalseAlarmRate 0.5 -numPos $((NUMPOS*9/10))\
+  -numNeg $((NUMPOS*2)) -w 21 -h 21 -featureType LBP -precalcValBufSize 1024\
+  -precalcIdxBufSize 1024
+
+echo "Cascade: $2/classifier/cascade.xml"
@@ -0,0 +1,115 @@
+#include <pthread.h>
+#include <libfreenect.h>
+#include "acquisition.hpp"
+#include "kinect.hpp"
+
+static freenect_context *context = NULL;
+static freenect_device *device = NULL;
+static pthread_t thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+static uint16_t *buffers[3];				// Being written by the driver, newest complete, being processed
+static uint32_t stamp;
+static int fresh, running = 0;
+static unsigned int dropped;
+
+static void depth_callback(freenect_device *dev, void *depth, uint32_t timestamp) {
+	pthread_mutex_lock(&mutex);
+	if(fresh)
+		dropped++;
+	buffers[0] = buffers[1];
+	buffers[1] = (uint16_t *) depth;
+	stamp = timestamp;
+	fresh = 1;
+	freenect_set_depth_buffer(dev, buffers[0]);
+	pthread_cond_signal(&ready);
+	pthread_mutex_unlock(&mutex);
+}
+
+static void *events(void *arg) {
+	while(running && freenect_process_events(context) >= 0);
+
+	// A device error also wakes the consumer
+	pthread_mutex_lock(&mutex);
+	running = 0;
+	pthread_cond_broadcast(&ready);
+	pthread_mutex_unlock(&mutex);
+
+	return NULL;
+}
+
+int acquisition_start(int camera_id) {
+	int i;
+
+	if(freenect_init(&context, NULL) < 0)
+		return 0;
+	freenect_select_subdevices(context, FREENECT_DEVICE_CAMERA);
+	if(freenect_open_device(context, &device, camera_id) < 0) {
+		freenect_shutdown(context);
+		context = NULL;
+		return 0;
+	}
+
+	for(i=0; i < 3; i++)
+		buffers[i] = new uint16_t[SIZE];
+	fresh = 0;
+	dropped = 0;
+
+	freenect_set_depth_mode(device, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
+	freenect_set_depth_buffer(device, buffers[0]);
+	freenect_set_depth_callback(device, depth_callback);
+	freenect_start_depth(device);
+
+	running = 1;
+	pthread_create(&thread, NULL, events, NULL);
+
+	return 1;
+}
+
+// Newest frame not yet returned, waiting for one if needed; it stays valid until the next call.
+// NULL once acquisition stopped.
+uint16_t *acquisition_depth(uint32_t *timestamp) {
+	uint16_t *t;
+
+	pthread_mutex_lock(&mutex);
+	while(!fresh && running)
+		pthread_cond_wait(&ready, &mutex);
+	if(!fresh) {
+		pthread_mutex_unlock(&mutex);
+		return NULL;
+	}
+	t = buffers[2];
+	buffers[2] = buffers[1];
+	buffers[1] = t;
+	fresh = 0;
+	if(timestamp)
+		*timestamp = stamp;
+	pthread_mutex_unlock(&mutex);
+
+	return buffers[2];
+}
+
+void acquisition_stop() {
+	int i;
+
+	if(!context)
+		return;
+
+	running = 0;
+	pthread_join(thread, NULL);
+	freenect_stop_depth(device);
+	freenect_close_device(device);
+	freenect_shutdown(context);
+	device = NULL;
+	context = NULL;
+
+	for(i=0; i < 3; i++) {
+		delete [] buffers[i];
+		buffers[i] = NULL;
+	}
+}
+
+// Frames replaced before they were read
+unsigned int acquisition_dropped() {
+	return dropped;
+}
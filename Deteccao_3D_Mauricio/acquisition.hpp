@@ -0,0 +1,9 @@
+#include <stdint.h>
+
+// Kinect v1 depth acquisition with libfreenect callbacks. The driver writes straight into one of
+// three preallocated frames; the callback swaps it with the newest complete frame and the caller
+// swaps that with the one it processes, so frames are never copied. Unread frames are replaced.
+int acquisition_start(int camera_id);
+uint16_t *acquisition_depth(uint32_t *timestamp);
+void acquisition_stop();
+unsigned int acquisition_dropped();
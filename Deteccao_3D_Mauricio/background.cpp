@@ -0,0 +1,94 @@
+#include "background.hpp"
+#include "kinect.hpp"
+
+struct BackgroundModel {
+	float mean[GRID_HEIGHT*GRID_WIDTH], var[GRID_HEIGHT*GRID_WIDTH];
+	int seen[GRID_HEIGHT*GRID_WIDTH];
+	uchar frozen[GRID_HEIGHT*GRID_WIDTH];
+};
+
+BackgroundModel *background_create() {
+	BackgroundModel *model = new BackgroundModel;
+	background_reset(model);
+	return model;
+}
+
+void background_release(BackgroundModel **model) {
+	delete *model;
+	*model = NULL;
+}
+
+void background_reset(BackgroundModel *model) {
+	memset(model->seen, 0, sizeof(model->seen));
+}
+
+// Mark grid samples that differ from the background model
+int background_subtract(BackgroundModel *model, Mat &depth, uchar *fg) {
+	float *mean = model->mean, *var = model->var;
+	int *seen = model->seen;
+	int i, j, g, n;
+	float d, s;
+
+	for(i=0, g=0, n=0; i < HEIGHT; i+=GRID_STEP)
+		for(j=0; j < WIDTH; j+=GRID_STEP, g++) {
+			d = depth.at<uint16_t>(i,j);
+			s = max((float)sqrt(var[g]), (float)BACKGROUND_MIN_STDDEV);
+			fg[g] = seen[g] < BACKGROUND_WARMUP || fabs(d-mean[g]) > BACKGROUND_SIGMA*s;
+			n += fg[g];
+		}
+
+	return n;
+}
+
+// Update running mean and variance of each grid sample
+void background_learn(BackgroundModel *model, Mat &depth, vector<Vec4d> &faces) {
+	float *mean = model->mean, *var = model->var;
+	int *seen = model->seen;
+	uchar *frozen = model->frozen;
+	int i, j, g, f, i0, i1, j0, j1;
+	float d, e, s, a;
+
+	// Samples around detected faces are never learnt, so a user sitting still is not absorbed
+	memset(frozen, 0, sizeof(model->frozen));
+	for(f=0; f < (int)faces.size(); f++) {
+		i0 = max(0, cvFloor((faces[f][1]-2.0*faces[f][2])/GRID_STEP));
+		i1 = min(GRID_HEIGHT-1, cvCeil((faces[f][1]+2.0*faces[f][2])/GRID_STEP));
+		j0 = max(0, cvFloor((faces[f][0]-2.0*faces[f][2])/GRID_STEP));
+		j1 = min(GRID_WIDTH-1, cvCeil((faces[f][0]+2.0*faces[f][2])/GRID_STEP));
+		for(i=i0; i <= i1; i++)
+			memset(frozen+i*GRID_WIDTH+j0, 1, j1-j0+1);
+	}
+
+	for(i=0, g=0; i < HEIGHT; i+=GRID_STEP)
+		for(j=0; j < WIDTH; j+=GRID_STEP, g++) {
+			d = depth.at<uint16_t>(i,j);
+			if(d >= DEPTH_RANGE-1 || frozen[g])
+				continue;
+
+			if(!seen[g]) {
+				mean[g] = d;
+				var[g] = 0.0f;
+				seen[g] = 1;
+				continue;
+			}
+
+			e = d-mean[g];
+			s = max((float)sqrt(var[g]), (float)BACKGROUND_MIN_STDDEV);
+			if(fabs(e) <= BACKGROUND_SIGMA*s)
+				a = max((float)BACKGROUND_ALPHA, 1.0f/(seen[g]+1));
+			else if(e > 0) {
+				// A farther surface was uncovered - restart the sample
+				mean[g] = d;
+				var[g] = 0.0f;
+				seen[g] = 1;
+				continue;
+			}
+			else
+				a = BACKGROUND_SLOW_ALPHA;
+
+			mean[g] += a*e;
+			var[g] = (1.0f-a)*(var[g]+a*e*e);
+			if(seen[g] < BACKGROUND_WARMUP)
+				seen[g]++;
+		}
+}
@@ -0,0 +1,13 @@
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Static background model over the sampled depth grid (fixed sensor only)
+typedef struct BackgroundModel BackgroundModel;
+
+BackgroundModel *background_create();
+void background_release(BackgroundModel **model);
+void background_reset(BackgroundModel *model);
+int background_subtract(BackgroundModel *model, Mat &depth, uchar *fg);
+void background_learn(BackgroundModel *model, Mat &depth, vector<Vec4d> &faces);
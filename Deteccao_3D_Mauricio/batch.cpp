@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include "batch.hpp"
+#include "detection.hpp"
+#include "stage_statistics.hpp"
+
+typedef struct {
+	BatchRead read;
+	BatchWrite write;
+	void *data;
+	int frontal, window;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int next, emitted, end;
+	vector<Vec4d> *faces;
+	uchar *done;
+} Batch;
+
+typedef struct {
+	Batch *batch;
+	DetectionContext *ctx;
+} BatchWorker;
+
+static void *batch_worker(void *arg) {
+	Batch *b = ((BatchWorker *) arg)->batch;
+	DetectionContext *ctx = ((BatchWorker *) arg)->ctx;
+	vector<Vec4d> faces;
+	Mat depth;
+	int frame, s;
+
+	for(;;) {
+		// Frames are read in order; a worker may run at most window frames ahead of the output
+		pthread_mutex_lock(&b->lock);
+		while(!b->end && b->next-b->emitted >= b->window)
+			pthread_cond_wait(&b->cond, &b->lock);
+		if(b->end || !b->read(b->data, depth)) {
+			b->end = 1;
+			pthread_cond_broadcast(&b->cond);
+			pthread_mutex_unlock(&b->lock);
+			break;
+		}
+		frame = b->next++;
+		pthread_mutex_unlock(&b->lock);
+
+		faces = b->frontal ? frontal_face_detection(ctx, depth) : face_detection(ctx, depth);
+
+		// Store the result and emit every frame that is now complete
+		pthread_mutex_lock(&b->lock);
+		s = frame%b->window;
+		b->faces[s] = faces;
+		b->done[s] = 1;
+		while(b->done[s = b->emitted%b->window]) {
+			b->write(b->data, b->emitted, b->faces[s]);
+			b->done[s] = 0;
+			b->emitted++;
+		}
+		pthread_cond_broadcast(&b->cond);
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	return NULL;
+}
+
+// Each worker has its own detector context. Frames of one worker are not consecutive,
+// so the background model and the change gate are not used here.
+int face_detection_batch(BatchRead read, BatchWrite write, void *data, int workers, int frontal) {
+	Batch b;
+	BatchWorker *w;
+	pthread_t *threads;
+	int i;
+
+	// Statistics are gathered by a single thread
+	if(workers < 1 || stage_statistics_active())
+		workers = 1;
+
+	b.read = read;
+	b.write = write;
+	b.data = data;
+	b.frontal = frontal;
+	b.window = 2*workers;
+	b.next = b.emitted = b.end = 0;
+	b.faces = new vector<Vec4d>[b.window];
+	b.done = (uchar *) calloc(b.window, sizeof(uchar));
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.cond, NULL);
+
+	// Contexts are created before the threads start (cascade loading is not thread safe)
+	threads = (pthread_t *) malloc(workers*sizeof(pthread_t));
+	w = (BatchWorker *) malloc(workers*sizeof(BatchWorker));
+	for(i=0; i < workers; i++) {
+		w[i].batch = &b;
+		w[i].ctx = detection_create(NULL);
+	}
+	for(i=0; i < workers; i++)
+		pthread_create(&threads[i], NULL, batch_worker, &w[i]);
+	for(i=0; i < workers; i++) {
+		pthread_join(threads[i], NULL);
+		detection_release(&w[i].ctx);
+	}
+
+	pthread_mutex_destroy(&b.lock);
+	pthread_cond_destroy(&b.cond);
+	free(threads);
+	free(w);
+	free(b.done);
+	delete[] b.faces;
+
+	return b.emitted;
+}
@@ -0,0 +1,12 @@
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Frame reader - fills depth with the next frame of the sequence; returns 0 at the end
+typedef int (*BatchRead)(void *data, Mat &depth);
+// Result writer - called once per frame, in frame order
+typedef void (*BatchWrite)(void *data, int frame, vector<Vec4d> &faces);
+
+// Frame-parallel detection of a recorded sequence; returns the number of frames processed
+int face_detection_batch(BatchRead read, BatchWrite write, void *data, int workers, int frontal);
@@ -0,0 +1,155 @@
+#include <fstream>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "kinect.hpp"
+#include "detection.hpp"
+
+using namespace cv;
+using namespace std;
+
+#define MERGE_CLUSTERS 4					// Synthetic candidate clusters for the merge benchmark
+#define MERGE_CANDIDATES 25					// Candidates per cluster
+
+typedef struct {
+	const char *name;
+	int64 ticks;
+	int calls;
+	double items;							// Work items per call (points, pixels, windows...)
+} Kernel;
+
+static void report(ostream &out, Kernel *k) {
+	double ms = k->ticks*1000.0/getTickFrequency();
+
+	out << k->name << "," << k->calls << "," << ms << "," << ms*1000.0/k->calls << "," << k->items << "," << k->items*k->calls/(ms/1000.0) << endl;
+}
+
+// Per kernel timing of the detector on a fixed frame.
+// Output is CSV: kernel,calls,total_ms,us_per_call,items_per_call,items_per_s
+int main(int argc, char *argv[]) {
+	int i, c, n, k, iterations = 100;
+	int64 t;
+	double matrix[3][3], imatrix[3][3], fi, fj, fs;
+	CvPoint3D64f *list, *candidates;
+	DetectionParams params;
+	DetectionContext *ctx;
+	Kernel kernels[7] = {{"cloud"}, {"rotation_projection"}, {"hole_filling"}, {"integrals"}, {"scan"}, {"merge"}, {"xyz2depth"}};
+	Mat depth;
+
+	if(argc < 2) {
+		cout << "Usage: " << argv[0] << " <depth.pgm> [iterations] [output.csv]" << endl;
+		return -1;
+	}
+
+	depth = imread(argv[1], CV_LOAD_IMAGE_ANYDEPTH);
+	if(depth.empty() || depth.type() != CV_16UC1 || depth.rows != HEIGHT || depth.cols != WIDTH) {
+		cout << argv[1] << ": not a " << WIDTH << "x" << HEIGHT << " 16-bit depth frame" << endl;
+		return -1;
+	}
+	if(argc > 2)
+		iterations = max(atoi(argv[2]), 1);
+
+	detection_default_params(&params);
+	ctx = detection_create(&params);
+
+	// Fixed pose with all three rotations, as in the general detection loop
+	computeRotationMatrix(matrix, imatrix, 10*0.017453293, 10*0.017453293, 0.0);
+
+	// Warm up caches and lazily built tables
+	n = detection_cloud(ctx, depth, DEPTH_THRESHOLD);
+	detection_projection(ctx, n, matrix);
+	detection_fill(ctx);
+	detection_integrals(ctx);
+	detection_scan(ctx, imatrix, 0, MAX_CANDIDATES);
+
+	for(i=0; i < 7; i++) {
+		kernels[i].ticks = 0;
+		kernels[i].calls = iterations;
+	}
+	kernels[0].items = GRID_WIDTH*GRID_HEIGHT;
+	kernels[1].items = n;
+	kernels[2].items = (int)(params.width*params.resolution)*(int)(params.width*params.resolution);
+	kernels[3].items = kernels[2].items;
+	kernels[4].items = ((int)(params.width*params.resolution)-20)*((int)(params.width*params.resolution)-20);
+	kernels[5].items = MERGE_CLUSTERS*MERGE_CANDIDATES;
+	kernels[6].items = MERGE_CLUSTERS*MERGE_CANDIDATES;
+
+	for(i=0; i < iterations; i++) {
+		t = getTickCount();
+		n = detection_cloud(ctx, depth, DEPTH_THRESHOLD);
+		kernels[0].ticks += getTickCount()-t;
+	}
+
+	for(i=0; i < iterations; i++) {
+		t = getTickCount();
+		computeRotationMatrix(matrix, imatrix, 10*0.017453293, 10*0.017453293, 0.0);
+		detection_projection(ctx, n, matrix);
+		kernels[1].ticks += getTickCount()-t;
+	}
+
+	// Hole filling changes the projection, so it is rebuilt (untimed) before each call
+	for(i=0; i < iterations; i++) {
+		detection_projection(ctx, n, matrix);
+		t = getTickCount();
+		detection_fill(ctx);
+		kernels[2].ticks += getTickCount()-t;
+	}
+
+	for(i=0; i < iterations; i++) {
+		t = getTickCount();
+		detection_integrals(ctx);
+		kernels[3].ticks += getTickCount()-t;
+	}
+
+	for(i=0; i < iterations; i++) {
+		t = getTickCount();
+		detection_scan(ctx, imatrix, 0, MAX_CANDIDATES);
+		kernels[4].ticks += getTickCount()-t;
+	}
+
+	// Candidates around a few faces 1 m away, jittered like overlapping windows of several poses
+	RNG rng(1);
+	candidates = (CvPoint3D64f *) malloc(3*MERGE_CLUSTERS*MERGE_CANDIDATES*sizeof(CvPoint3D64f));
+	list = candidates+MERGE_CLUSTERS*MERGE_CANDIDATES;
+	for(c=0, k=0; c < MERGE_CLUSTERS; c++)
+		for(i=0; i < MERGE_CANDIDATES; i++, k++) {
+			candidates[k].x = -450.0+300.0*c+rng.uniform(-15.0, 15.0);
+			candidates[k].y = rng.uniform(-15.0, 15.0);
+			candidates[k].z = -250.0+rng.uniform(-15.0, 15.0);
+		}
+
+	// The merge consumes its input, so it is copied (untimed) before each call
+	for(i=0; i < iterations; i++) {
+		memcpy(list, candidates, k*sizeof(CvPoint3D64f));
+		t = getTickCount();
+		merge_detections(list, list+k, k);
+		kernels[5].ticks += getTickCount()-t;
+	}
+
+	for(i=0; i < iterations; i++) {
+		t = getTickCount();
+		for(c=0; c < k; c++)
+			xyz2depth(&candidates[c], &fi, &fj, &fs);
+		kernels[6].ticks += getTickCount()-t;
+	}
+
+	free(candidates);
+	detection_release(&ctx);
+
+	if(argc > 3) {
+		ofstream output(argv[3]);
+		if(!output) {
+			cout << "Could not write to " << argv[3] << endl;
+			return -1;
+		}
+		output << "kernel,calls,total_ms,us_per_call,items_per_call,items_per_s" << endl;
+		for(i=0; i < 7; i++)
+			report(output, &kernels[i]);
+	}
+	else {
+		cout << "kernel,calls,total_ms,us_per_call,items_per_call,items_per_s" << endl;
+		for(i=0; i < 7; i++)
+			report(cout, &kernels[i]);
+	}
+
+	return 0;
+}
@@ -1,25 +1,20 @@
+#include <limits.h>
 #include "detection.hpp"
+#include "background.hpp"
+#include "stage_statistics.hpp"
+#include "lbp_cascade.hpp"
 #include "kinect.hpp"
 
-void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3], double background) {
-	static int flag = 1, height, width, size, cx, cy, *li, *lj, *lc;
-	int i, j, k, l, c, t;
+// Orthographic projection of the cloud - nearest point per pixel, m marks covered pixels
+void project_cloud(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3]) {
+	int i, j, k, height, width, cx, cy;
 	double d;
 
-	if(flag) {
-		flag = 0;
-
-		height = p->height;
-		width = p->width;
-		size = height*width;
+	height = p->height;
+	width = p->width;
 
-		li = (int *) malloc(3*size*sizeof(int));
-		lj = li+size;
-		lc = lj+size;
-
-		cx = width/2;
-		cy = height/2;
-	}
+	cx = width/2;
+	cy = height/2;
 
 	// Compute projection
 	cvSet(p, cvRealScalar(-DBL_MAX), NULL);
@@ -34,6 +29,20 @@ void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, doub
 			CV_IMAGE_ELEM(m, uchar, j, k) = 1;
 		}
 	}
+}
+
+// Buffer holds the hole filling queue (3*width*height ints); holes are filled up to fill pixels deep
+void fill_holes(IplImage *p, IplImage *m, double background, int *buffer, int fill) {
+	int i, j, k, l, c, t, height, width, size, *li, *lj, *lc;
+	double d;
+
+	height = p->height;
+	width = p->width;
+	size = height*width;
+
+	li = buffer;
+	lj = li+size;
+	lc = lj+size;
 
 	// Hole filling
 	k=l=0;
@@ -50,7 +59,7 @@ void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, doub
 		i = li[k];
 		j = lj[k];
 		c = lc[k];
-		if(!CV_IMAGE_ELEM(m, uchar, i, j) && i > 0 && i < height-1 && j > 0 && j < width-1 && c < FACE_HALF_SIZE) {
+		if(!CV_IMAGE_ELEM(m, uchar, i, j) && i > 0 && i < height-1 && j > 0 && j < width-1 && c < fill) {
 			CV_IMAGE_ELEM(m, uchar, i, j) = c+1;
 			t = 0;
 			d = 0.0f;
@@ -109,6 +118,11 @@ void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, doub
 		}
 }
 
+void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3], double background, int *buffer, int fill) {
+	project_cloud(p, m, xyz, n, matrix);
+	fill_holes(p, m, background, buffer, fill);
+}
+
 // Compute rotation matrix and its inverse matrix
 void computeRotationMatrix(double matrix[3][3], double imatrix[3][3], double aX, double aY, double aZ) {
 	double cosX, cosY, cosZ, sinX, sinY, sinZ, d;
@@ -152,31 +166,124 @@ void xyz2depth(CvPoint3D64f *pt, double *i, double *j, double *s) {
 	*s = fabs(((pt->x+100.0)/z)*DEPTH_FX+DEPTH_CX-*j);
 }
 
-vector<Vec4d> face_detection_(Mat &depth, int minX, int maxX, int minY, int maxY, int minZ, int maxZ, double thr) {
-	static int flag = 1, width, height, cx, cy;
-	static IplImage *p, *v, *m, *sum, *sqsum, *tiltedsum, *msum, *sumint, *tiltedsumint;
-	static CvPoint3D64f *xyz, *list, *clist;
-	static CvPoint2D64f *xy;
-	static double *z, background;
-	static CvHaarClassifierCascade *face_cascade;
-	int i, j, k, l, n, aX, aY, aZ;
-	double matrix[3][3], imatrix[3][3], X, Y, Z;
-	CvPoint3D64f avg;
+// Depth cascade - legacy Haar or integer LBP
+typedef struct {
+	CvHaarClassifierCascade *haar;
+	LbpCascade *lbp;
+	int count;
+} DepthCascade;
 
-	if(flag) {
-		flag = 0;
+static const char *cascade_file = CASCADE_FILE;
 
-		width = (int)(X_WIDTH*RESOLUTION);
-		height = (int)(X_WIDTH*RESOLUTION);
+void detection_cascade(const char *filename) {
+	cascade_file = filename;
+}
+
+static int run_cascade(const DepthCascade *cascade, int i, int j) {
+	if(cascade->lbp)
+		return lbp_cascade_run(cascade->lbp, i, j);
+	return cvRunHaarClassifierCascade(cascade->haar, cvPoint(j,i), 0);
+}
 
-		cx = width/2;
-		cy = height/2;
+// Run the cascade on a window; returns the number of stages passed
+static int run_window(const DepthCascade *cascade, IplImage *msum, int i, int j) {
+	int r;
+	int64 t;
+
+	// Windows must be fully covered by the projection
+	if(CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j)+CV_IMAGE_ELEM(msum, int, i, j) != 441) {
+		if(stage_statistics_active())
+			stage_statistics_masked();
+		return 0;
+	}
 
-		p = cvCreateImage(cvSize(width, height), IPL_DEPTH_64F, 1);
-		m = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
-		v = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	if(stage_statistics_active()) {
+		t = cvGetTickCount();
+		r = run_cascade(cascade, i, j);
+		r = r > 0 ? cascade->count : -r;
+		stage_statistics_window(r, cvGetTickCount()-t);
+		return r;
+	}
+
+	r = run_cascade(cascade, i, j);
+	return r > 0 ? cascade->count : -r;
+}
+
+// Scan of window tiles - coarse grid (pass 0) or dense refinement (pass 1)
+class ScanTiles : public ParallelLoopBody {
+public:
+	ScanTiles(const DepthCascade *cascade, IplImage *msum, int *stage, int sw, int sh, int pass) :
+		cascade(cascade), msum(msum), stage(stage), sw(sw), sh(sh), pass(pass) {
+		tw = (sw+SCAN_TILE_WIDTH-1)/SCAN_TILE_WIDTH;
+	}
+
+	void operator()(const Range &range) const {
+		int t, i, j, i0, i1, j0, j1;
+
+		for(t=range.start; t < range.end; t++) {
+			i0 = (t/tw)*SCAN_TILE_HEIGHT;
+			j0 = (t%tw)*SCAN_TILE_WIDTH;
+			i1 = min(sh, i0+SCAN_TILE_HEIGHT);
+			j1 = min(sw, j0+SCAN_TILE_WIDTH);
+
+			if(pass == 0) {
+				for(i=(i0+SCAN_STRIDE-1)/SCAN_STRIDE*SCAN_STRIDE; i < i1; i+=SCAN_STRIDE)
+					for(j=(j0+SCAN_STRIDE-1)/SCAN_STRIDE*SCAN_STRIDE; j < j1; j+=SCAN_STRIDE)
+						stage[i*sw+j] = run_window(cascade, msum, i, j);
+			}
+			else {
+				for(i=i0; i < i1; i++)
+					for(j=j0; j < j1; j++)
+						if(stage[i*sw+j] < 0 && refine(i, j))
+							stage[i*sw+j] = run_window(cascade, msum, i, j);
+			}
+		}
+	}
+
+	int tiles() const {
+		return tw*((sh+SCAN_TILE_HEIGHT-1)/SCAN_TILE_HEIGHT);
+	}
+
+private:
+	// Check if a coarse window up to SCAN_STRIDE-1 pixels away reached a late stage
+	int refine(int i, int j) const {
+		int ci, cj;
+
+		for(ci=(max(0, i-SCAN_STRIDE+1)+SCAN_STRIDE-1)/SCAN_STRIDE*SCAN_STRIDE; ci < i+SCAN_STRIDE && ci < sh; ci+=SCAN_STRIDE)
+			for(cj=(max(0, j-SCAN_STRIDE+1)+SCAN_STRIDE-1)/SCAN_STRIDE*SCAN_STRIDE; cj < j+SCAN_STRIDE && cj < sw; cj+=SCAN_STRIDE)
+				if(stage[ci*sw+cj] >= SCAN_REFINE_STAGE)
+					return 1;
+
+		return 0;
+	}
+
+	const DepthCascade *cascade;
+	IplImage *msum;
+	int *stage, sw, sh, tw, pass;
+};
+
+static int parallel_scan = 0;
+
+void parallel_scan_enable(int enable) {
+	parallel_scan = enable;
+}
+
+// Background value of the projection (depth threshold)
+double projection_background() {
+	return -DEPTH_Z3*tan(DEPTH_THRESHOLD/DEPTH_Z2+DEPTH_Z1)*RESOLUTION+DEPTH_Z4;
+}
+
+// Lookup tables shared by every context (read-only once built)
+static CvPoint2D64f *xy;
+static double *z;
+
+static void depth_tables() {
+	static int flag = 1;
+	int i, j, k;
+
+	if(flag) {
+		flag = 0;
 
-		xyz = (CvPoint3D64f *) malloc(SIZE*sizeof(CvPoint3D64f));
 		xy = (CvPoint2D64f *) malloc(SIZE*sizeof(CvPoint2D64f));
 		z = (double *) malloc(DEPTH_RANGE*sizeof(double));
 
@@ -188,75 +295,295 @@ vector<Vec4d> face_detection_(Mat &depth, int minX, int maxX, int minY, int maxY
 
 		for(i=0; i < DEPTH_RANGE; i++)
 			z[i] = -DEPTH_Z3*tan(i/DEPTH_Z2+DEPTH_Z1)*RESOLUTION;
-		background = z[DEPTH_THRESHOLD]+DEPTH_Z4;
-
-		face_cascade = (CvHaarClassifierCascade *) cvLoad("ALL_Spring2003_3D.xml", 0, 0, 0);
-
-		sum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
-		sqsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
-		tiltedsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
-		sumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
-		tiltedsumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
-		msum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
-
-		list = (CvPoint3D64f *) malloc(2000*sizeof(CvPoint3D64f));
-		clist = list+1000;
 	}
+}
 
-	// Convert depth to 3D coordinates with grid sampling
-	for(i=0, k=0, n=0; i < HEIGHT; i+=6, k=i*WIDTH)
-		for(j=0; j < WIDTH; j+=6, k+=6) {
+// Sample the depth every step pixels; zt converts disparity to projection units
+static int sample_cloud(Mat &depth, CvPoint3D64f *xyz, double thr, uchar *fg, int step, const double *zt, double z4) {
+	int i, j, k, l, n, g;
+
+	for(i=0, k=0, n=0, g=0; i < HEIGHT; i+=step, k=i*WIDTH)
+		for(j=0; j < WIDTH; j+=step, k+=step, g++) {
 			l = depth.at<uint16_t>(i,j);
-			if(l < thr) {
-				xyz[n].x = -xy[k].x*z[l];
-				xyz[n].y = xy[k].y*z[l];
-				xyz[n].z = z[l]+DEPTH_Z4;
+			if(l < thr && (!fg || fg[g])) {
+				xyz[n].x = -xy[k].x*zt[l];
+				xyz[n].y = xy[k].y*zt[l];
+				xyz[n].z = zt[l]+z4;
 				n++;
 			}
 		}
 
-	// Detection loop
-	for(aX=minX, k=0; aX <= maxX; aX += 10) {
-	for(aY=minY; aY <= maxY; aY += 10) {
-	for(aZ=minZ; aZ <= maxZ; aZ += 10) {
-		if(aX+aY+aZ > 30)
-			continue;
+	return n;
+}
 
-		//aY = 0;
-		//aZ = 0;
+// Convert depth to 3D coordinates with grid sampling; fg (optional) selects grid samples
+int depth_cloud(Mat &depth, CvPoint3D64f *xyz, double thr, uchar *fg) {
+	depth_tables();
+	return sample_cloud(depth, xyz, thr, fg, GRID_STEP, z, DEPTH_Z4);
+}
 
-		computeRotationMatrix(matrix, imatrix, aX*0.017453293, aY*0.017453293, aZ*0.017453293);
-		compute_projection(p, m, xyz, n, matrix, background);
+void detection_default_params(DetectionParams *params) {
+	params->resolution = RESOLUTION;
+	params->width = X_WIDTH;
+	params->pose_step = 10;
+	params->max_x = 30;
+	params->min_y = -20;
+	params->max_y = 20;
+	params->max_pose_sum = 30;
+	params->grid_step = GRID_STEP;
+	params->fill_depth = FACE_HALF_SIZE;
+}
 
-		cvIntegral(p, sum, sqsum, tiltedsum);
-		cvIntegral(m, msum, NULL, NULL);
+// Poses face_detection scans per frame with these parameters
+int detection_pose_count(const DetectionParams *params) {
+	int aX, aY, n = 0;
 
-		for(i=0; i < height+1; i++)
-			for(j=0; j < width+1; j++) {
-				CV_IMAGE_ELEM(sumint, int, i, j) = CV_IMAGE_ELEM(sum, double, i, j);
-				CV_IMAGE_ELEM(tiltedsumint, int, i, j) = CV_IMAGE_ELEM(tiltedsum, double, i, j);
-			}
+	if(params->pose_step <= 0)
+		return INT_MAX;
+	for(aX=0; aX <= params->max_x; aX += params->pose_step)
+		for(aY=params->min_y; aY <= params->max_y; aY += params->pose_step)
+			if(aX+aY <= params->max_pose_sum)
+				n++;
+	return n;
+}
 
-		cvSetImagesForHaarClassifierCascade(face_cascade, sumint, sqsum, tiltedsumint, 1.0);
+// Frame change gate
+typedef struct {
+	uint16_t ref[GATE_HEIGHT*GATE_WIDTH];
+	vector<Vec4d> faces;
+	int age;
+} GateCache;
+
+// Detector state - one per thread or depth stream
+struct DetectionContext {
+	DetectionParams params;
+	double *z, z4;
+	int width, height, cx, cy, sw, sh;
+	IplImage *p, *q, *m, *sum, *sqsum, *tiltedsum, *msum, *sumint, *tiltedsumint;
+	CvPoint3D64f *xyz, *list, *clist;
+	double background;
+	DepthCascade cascade;
+	uchar *fg;
+	int *stage, *queue;
+	BackgroundModel *bg;
+	GateCache full, frontal;
+	int gate, gate_frames, gate_skipped;
+};
+
+DetectionContext *detection_create(const DetectionParams *params) {
+	DetectionContext *ctx = new DetectionContext;
+	int i, width, height;
+	double res;
+
+	depth_tables();
+
+	if(params)
+		ctx->params = *params;
+	else
+		detection_default_params(&ctx->params);
+	res = ctx->params.resolution;
+	if(detection_pose_count(&ctx->params) > MAX_POSES) {
+		fprintf(stderr, "%d poses per frame, the detector scans at most %d\n", detection_pose_count(&ctx->params), MAX_POSES);
+		exit(1);
+	}
 
-		for(i=0; i < height-20; i++)
-			for(j=0; j < width-20; j++)
-				if(CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i, j+FACE_SIZE)-CV_IMAGE_ELEM(msum, int, i+FACE_SIZE, j)+CV_IMAGE_ELEM(msum, int, i, j) == 441)
-					if(cvRunHaarClassifierCascade(face_cascade, cvPoint(j,i), 0) > 0) {
-						X = (j+FACE_HALF_SIZE-cx)/RESOLUTION;
-						Y = (cy-i-FACE_HALF_SIZE)/RESOLUTION;
-						Z = (CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE-5)+CV_IMAGE_ELEM(sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE-5))/121.0/RESOLUTION;
+	// Disparity to projection units at this resolution
+	ctx->z = (double *) malloc(DEPTH_RANGE*sizeof(double));
+	for(i=0; i < DEPTH_RANGE; i++)
+		ctx->z[i] = -DEPTH_Z3*tan(i/DEPTH_Z2+DEPTH_Z1)*res;
+	ctx->z4 = DEPTH_Z4/RESOLUTION*res;
+
+	ctx->width = width = (int)(ctx->params.width*res);
+	ctx->height = height = (int)(ctx->params.width*res);
+
+	ctx->cx = width/2;
+	ctx->cy = height/2;
+
+	ctx->p = cvCreateImage(cvSize(width, height), IPL_DEPTH_64F, 1);
+	ctx->m = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	ctx->queue = (int *) malloc(3*width*height*sizeof(int));
+
+	ctx->xyz = (CvPoint3D64f *) malloc(SIZE*sizeof(CvPoint3D64f));
+	ctx->background = projection_background()/RESOLUTION*res;
+
+	// Each context owns its cascade, which keeps pointers to the context images
+	// LBP cascades need only the integral of the quantized projection
+	ctx->q = ctx->sum = ctx->sqsum = ctx->tiltedsum = ctx->tiltedsumint = NULL;
+	ctx->cascade.lbp = lbp_cascade_load(cascade_file);
+	if(ctx->cascade.lbp) {
+		ctx->cascade.haar = NULL;
+		ctx->cascade.count = ctx->cascade.lbp->count;
+		ctx->q = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	}
+	else {
+		ctx->cascade.haar = (CvHaarClassifierCascade *) cvLoad(cascade_file, 0, 0, 0);
+		if(!ctx->cascade.haar || ctx->cascade.haar->orig_window_size.width != FACE_SIZE || ctx->cascade.haar->orig_window_size.height != FACE_SIZE) {
+			fprintf(stderr, "%s: not a cascade with a %dx%d window\n", cascade_file, FACE_SIZE, FACE_SIZE);
+			exit(1);
+		}
+		ctx->cascade.count = ctx->cascade.haar->count;
+		ctx->sum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+		ctx->sqsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+		ctx->tiltedsum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_64F, 1);
+		ctx->tiltedsumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
+	}
+	ctx->sumint = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
+	ctx->msum = cvCreateImage(cvSize(width+1, height+1), IPL_DEPTH_32S, 1);
 
-						list[k].x = X*imatrix[0][0]+Y*imatrix[0][1]+Z*imatrix[0][2];
-						list[k].y = X*imatrix[1][0]+Y*imatrix[1][1]+Z*imatrix[1][2];
-						list[k].z = X*imatrix[2][0]+Y*imatrix[2][1]+Z*imatrix[2][2];
-						k++;
-					}
+	ctx->list = (CvPoint3D64f *) malloc(2*MAX_CANDIDATES*sizeof(CvPoint3D64f));
+	ctx->clist = ctx->list+MAX_CANDIDATES;
+
+	ctx->fg = (uchar *) malloc(GRID_HEIGHT*GRID_WIDTH*sizeof(uchar));
+
+	ctx->sw = width-20;
+	ctx->sh = height-20;
+	ctx->stage = (int *) malloc(ctx->sw*ctx->sh*sizeof(int));
+
+	ctx->bg = NULL;
+	ctx->full.age = ctx->frontal.age = 0;
+	ctx->gate = ctx->gate_frames = ctx->gate_skipped = 0;
+
+	return ctx;
+}
+
+void detection_release(DetectionContext **ctx) {
+	DetectionContext *c = *ctx;
+
+	if(!c)
+		return;
+
+	cvReleaseImage(&c->p);
+	cvReleaseImage(&c->m);
+	cvReleaseImage(&c->sumint);
+	cvReleaseImage(&c->msum);
+	if(c->cascade.lbp) {
+		lbp_cascade_release(&c->cascade.lbp);
+		cvReleaseImage(&c->q);
 	}
+	else {
+		cvReleaseHaarClassifierCascade(&c->cascade.haar);
+		cvReleaseImage(&c->sum);
+		cvReleaseImage(&c->sqsum);
+		cvReleaseImage(&c->tiltedsum);
+		cvReleaseImage(&c->tiltedsumint);
 	}
+	background_release(&c->bg);
+
+	free(c->z);
+	free(c->queue);
+	free(c->xyz);
+	free(c->list);
+	free(c->fg);
+	free(c->stage);
+
+	delete c;
+	*ctx = NULL;
+}
+
+// NULL selects the default context used by the single stream functions
+static DetectionContext *context(DetectionContext *ctx) {
+	static DetectionContext *def = NULL;
+
+	if(ctx)
+		return ctx;
+	if(!def)
+		def = detection_create(NULL);
+	return def;
+}
+
+// The background model works on the default sampling grid only
+void detection_background(DetectionContext *ctx, int enable) {
+	ctx = context(ctx);
+	if(enable && !ctx->bg && ctx->params.grid_step == GRID_STEP)
+		ctx->bg = background_create();
+	else if(!enable)
+		background_release(&ctx->bg);
+}
+
+// Sample the depth frame into the context cloud; returns the number of points
+int detection_cloud(DetectionContext *ctx, Mat &depth, double thr) {
+	// Drop samples that belong to the static background
+	if(ctx->bg) {
+		background_subtract(ctx->bg, depth, ctx->fg);
+		return sample_cloud(depth, ctx->xyz, thr, ctx->fg, GRID_STEP, ctx->z, ctx->z4);
 	}
+	return sample_cloud(depth, ctx->xyz, thr, NULL, ctx->params.grid_step, ctx->z, ctx->z4);
+}
+
+void detection_projection(DetectionContext *ctx, int n, double matrix[3][3]) {
+	project_cloud(ctx->p, ctx->m, ctx->xyz, n, matrix);
+}
+
+void detection_fill(DetectionContext *ctx) {
+	fill_holes(ctx->p, ctx->m, ctx->background, ctx->queue, ctx->params.fill_depth);
+}
+
+// Integral images of the projection and of its coverage mask
+void detection_integrals(DetectionContext *ctx) {
+	int i, j;
+
+	if(ctx->cascade.lbp) {
+		cvConvertScale(ctx->p, ctx->q, LBP_SCALE, -ctx->background*LBP_SCALE);
+		cvIntegral(ctx->q, ctx->sumint, NULL, NULL);
+		lbp_cascade_set_image(ctx->cascade.lbp, ctx->sumint);
+	}
+	else {
+		cvIntegral(ctx->p, ctx->sum, ctx->sqsum, ctx->tiltedsum);
+
+		for(i=0; i < ctx->height+1; i++)
+			for(j=0; j < ctx->width+1; j++) {
+				CV_IMAGE_ELEM(ctx->sumint, int, i, j) = CV_IMAGE_ELEM(ctx->sum, double, i, j);
+				CV_IMAGE_ELEM(ctx->tiltedsumint, int, i, j) = CV_IMAGE_ELEM(ctx->tiltedsum, double, i, j);
+			}
+
+		cvSetImagesForHaarClassifierCascade(ctx->cascade.haar, ctx->sumint, ctx->sqsum, ctx->tiltedsumint, 1.0);
+	}
+	cvIntegral(ctx->m, ctx->msum, NULL, NULL);
+}
+
+// Scan the projection and append faces to the candidate list from position k; returns the new count.
+// Faces beyond capacity candidates are dropped
+int detection_scan(DetectionContext *ctx, double imatrix[3][3], int k, int capacity) {
+	int i, j, pass;
+	double X, Y, Z, res = ctx->params.resolution;
+
+	// Tiled scan - coarse grid first, then dense refinement (-1 marks windows not evaluated)
+	memset(ctx->stage, 0xFF, ctx->sw*ctx->sh*sizeof(int));
+	for(pass=0; pass < (SCAN_STRIDE > 1 ? 2 : 1); pass++) {
+		ScanTiles scan(&ctx->cascade, ctx->msum, ctx->stage, ctx->sw, ctx->sh, pass);
+		// Statistics are gathered by a single thread
+		if(parallel_scan && !stage_statistics_active())
+			parallel_for_(Range(0, scan.tiles()), scan);
+		else
+			scan(Range(0, scan.tiles()));
+	}
+
+	// Windows that passed every stage
+	for(i=0; i < ctx->sh; i++)
+		for(j=0; j < ctx->sw && k < capacity; j++)
+			if(ctx->stage[i*ctx->sw+j] == ctx->cascade.count) {
+				X = (j+FACE_HALF_SIZE-ctx->cx)/res;
+				Y = (ctx->cy-i-FACE_HALF_SIZE)/res;
+				if(ctx->cascade.lbp)
+					Z = ((CV_IMAGE_ELEM(ctx->sumint, int, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(ctx->sumint, int, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(ctx->sumint, int, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE-5)+CV_IMAGE_ELEM(ctx->sumint, int, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE-5))/121.0/LBP_SCALE+ctx->background)/res;
+				else
+					Z = (CV_IMAGE_ELEM(ctx->sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(ctx->sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE+6)-CV_IMAGE_ELEM(ctx->sum, double, i+FACE_HALF_SIZE+6, j+FACE_HALF_SIZE-5)+CV_IMAGE_ELEM(ctx->sum, double, i+FACE_HALF_SIZE-5, j+FACE_HALF_SIZE-5))/121.0/res;
+
+				ctx->list[k].x = X*imatrix[0][0]+Y*imatrix[0][1]+Z*imatrix[0][2];
+				ctx->list[k].y = X*imatrix[1][0]+Y*imatrix[1][1]+Z*imatrix[1][2];
+				ctx->list[k].z = X*imatrix[2][0]+Y*imatrix[2][1]+Z*imatrix[2][2];
+				k++;
+			}
+
+	return k;
+}
+
+// Group candidates closer than 50 mm; list is consumed, clist is scratch space of the same size
+vector<Vec4d> merge_detections(CvPoint3D64f *list, CvPoint3D64f *clist, int k) {
+	int i, j, l;
+	double X;
+	CvPoint3D64f avg;
 
-	// Merge multiple detections
 	vector<Vec4d> r;
 	Vec4d tmp;
 	while(k > 0) {
@@ -301,11 +628,109 @@ vector<Vec4d> face_detection_(Mat &depth, int minX, int maxX, int minY, int maxY
 	return r;
 }
 
+static vector<Vec4d> face_detection_(DetectionContext *ctx, Mat &depth, int minX, int maxX, int minY, int maxY, int minZ, int maxZ, double thr) {
+	int k, n, aX, aY, aZ, step = ctx->params.pose_step;
+	double matrix[3][3], imatrix[3][3];
+
+	n = detection_cloud(ctx, depth, thr);
+
+	// Detection loop
+	for(aX=minX, k=0; aX <= maxX; aX += step) {
+	for(aY=minY; aY <= maxY; aY += step) {
+	for(aZ=minZ; aZ <= maxZ; aZ += step) {
+		if(aX+aY+aZ > ctx->params.max_pose_sum)
+			continue;
+
+		//aY = 0;
+		//aZ = 0;
+
+		computeRotationMatrix(matrix, imatrix, aX*0.017453293, aY*0.017453293, aZ*0.017453293);
+		detection_projection(ctx, n, matrix);
+		detection_fill(ctx);
+		detection_integrals(ctx);
+		k = detection_scan(ctx, imatrix, k, MAX_CANDIDATES);
+
+		stage_statistics_pose(aX, aY, aZ, ctx->cascade.count);
+	}
+	}
+	}
+
+	stage_statistics_frame();
+
+	// Merge multiple detections
+	vector<Vec4d> r = merge_detections(ctx->list, ctx->clist, k);
+
+	if(ctx->bg)
+		background_learn(ctx->bg, depth, r);
+
+	return r;
+}
+
+
+void detection_gate(DetectionContext *ctx, int enable) {
+	ctx = context(ctx);
+	ctx->gate = enable;
+	ctx->gate_frames = ctx->gate_skipped = 0;
+	ctx->full.age = ctx->frontal.age = 0;
+}
+
+double detection_skip_rate(DetectionContext *ctx) {
+	ctx = context(ctx);
+	return ctx->gate_frames ? (double)ctx->gate_skipped/ctx->gate_frames : 0.0;
+}
+
+// Block-wise sum of absolute differences on the downsampled frame
+static int frame_changed(Mat &depth, uint16_t *ref) {
+	int i, j, b, sad[GATE_BLOCKS_Y*GATE_BLOCKS_X];
+
+	memset(sad, 0, sizeof(sad));
+	for(i=0; i < GATE_HEIGHT; i++)
+		for(j=0; j < GATE_WIDTH; j++)
+			sad[(i/GATE_BLOCK)*GATE_BLOCKS_X+j/GATE_BLOCK] += min(abs(depth.at<uint16_t>(i*GATE_STEP,j*GATE_STEP)-ref[i*GATE_WIDTH+j]), GATE_CLAMP);
+
+	for(b=0; b < GATE_BLOCKS_Y*GATE_BLOCKS_X; b++)
+		if(sad[b] > GATE_THRESHOLD*GATE_BLOCK*GATE_BLOCK)
+			return 1;
+
+	return 0;
+}
+
+static vector<Vec4d> gated_face_detection(DetectionContext *ctx, GateCache *c, Mat &depth, int minX, int maxX, int minY, int maxY, int minZ, int maxZ, double thr) {
+	int i, j;
+
+	if(!ctx->gate)
+		return face_detection_(ctx, depth, minX, maxX, minY, maxY, minZ, maxZ, thr);
+
+	ctx->gate_frames++;
+	if(c->age > 0 && c->age < GATE_REFRESH && !frame_changed(depth, c->ref)) {
+		c->age++;
+		ctx->gate_skipped++;
+		return c->faces;
+	}
+
+	c->faces = face_detection_(ctx, depth, minX, maxX, minY, maxY, minZ, maxZ, thr);
+	for(i=0; i < GATE_HEIGHT; i++)
+		for(j=0; j < GATE_WIDTH; j++)
+			c->ref[i*GATE_WIDTH+j] = depth.at<uint16_t>(i*GATE_STEP,j*GATE_STEP);
+	c->age = 1;
+
+	return c->faces;
+}
+
+vector<Vec4d> face_detection(DetectionContext *ctx, Mat &depth) {
+	ctx = context(ctx);
+	return gated_face_detection(ctx, &ctx->full, depth, 0, ctx->params.max_x, ctx->params.min_y, ctx->params.max_y, 0, 0, DEPTH_THRESHOLD);
+}
+
+vector<Vec4d> frontal_face_detection(DetectionContext *ctx, Mat &depth) {
+	ctx = context(ctx);
+	return gated_face_detection(ctx, &ctx->frontal, depth, 0, 0, 0, 0, 0, 0, DEPTH_CTHRESHOLD);
+}
+
 vector<Vec4d> face_detection(Mat &depth) {
-	return face_detection_(depth, 0, 30, -20, 20, 0, 0, DEPTH_THRESHOLD);
+	return face_detection(NULL, depth);
 }
 
 vector<Vec4d> frontal_face_detection(Mat &depth) {
-	return face_detection_(depth, 0, 0, 0, 0, 0, 0, DEPTH_CTHRESHOLD);
+	return frontal_face_detection(NULL, depth);
 }
-
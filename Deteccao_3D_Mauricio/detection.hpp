@@ -4,6 +4,49 @@
 using namespace cv;
 using namespace std;
 
+void computeRotationMatrix(double matrix[3][3], double imatrix[3][3], double aX, double aY, double aZ);
+void project_cloud(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3]);
+void fill_holes(IplImage *p, IplImage *m, double background, int *buffer, int fill);
+void compute_projection(IplImage *p, IplImage *m, CvPoint3D64f *xyz, int n, double matrix[3][3], double background, int *buffer, int fill);
+int depth_cloud(Mat &depth, CvPoint3D64f *xyz, double thr, uchar *fg);
+double projection_background();
+vector<Vec4d> merge_detections(CvPoint3D64f *list, CvPoint3D64f *clist, int k);
+void xyz2depth(CvPoint3D64f *pt, double *i, double *j, double *s);
+
+void detection_cascade(const char *filename);
+void parallel_scan_enable(int enable);
+
+// Runtime detection parameters (defaults from kinect.hpp)
+typedef struct {
+	double resolution;		// Projection resolution - in pixels per mm
+	double width;			// Orthogonal projection width - in mm
+	int pose_step;			// Head pose step - in degrees
+	int max_x, min_y, max_y;	// Pose ranges of face_detection - in degrees
+	int max_pose_sum;		// Poses with aX+aY+aZ above this are skipped - in degrees
+	int grid_step;			// Depth sampling step - in pixels
+	int fill_depth;			// Hole filling depth - in pixels
+} DetectionParams;
+
+void detection_default_params(DetectionParams *params);
+int detection_pose_count(const DetectionParams *params);
+
+// Detector state - one per thread or depth stream (NULL selects the default context)
+typedef struct DetectionContext DetectionContext;
+
+DetectionContext *detection_create(const DetectionParams *params);
+void detection_release(DetectionContext **ctx);
+void detection_background(DetectionContext *ctx, int enable);
+void detection_gate(DetectionContext *ctx, int enable);
+double detection_skip_rate(DetectionContext *ctx);
+
+vector<Vec4d> face_detection(DetectionContext *ctx, Mat &depth);
+vector<Vec4d> frontal_face_detection(DetectionContext *ctx, Mat &depth);
 vector<Vec4d> face_detection(Mat &depth);
 vector<Vec4d> frontal_face_detection(Mat &depth);
 
+// Detector stages, in the order face_detection runs them for each pose
+int detection_cloud(DetectionContext *ctx, Mat &depth, double thr);
+void detection_projection(DetectionContext *ctx, int n, double matrix[3][3]);
+void detection_fill(DetectionContext *ctx);
+void detection_integrals(DetectionContext *ctx);
+int detection_scan(DetectionContext *ctx, double imatrix[3][3], int k, int capacity);
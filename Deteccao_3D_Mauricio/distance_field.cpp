@@ -0,0 +1,144 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "distance_field.hpp"
+
+// The grid covers the model bounding box plus a margin; queries farther than the margin
+// from the box cannot have a match closer than the margin, so they are left unmatched
+DistanceField *field_build(const KdTree *model, float resolution, float margin) {
+	DistanceField *field;
+	FieldHeader *h;
+	CvPoint3D32f q;
+	float mn[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, mx[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX}, d2;
+	int i, x, y, z;
+	size_t k;
+
+	if(model->n < 1 || model->n >= FIELD_NONE)
+		return NULL;
+
+	for(i=0; i < model->n; i++) {
+		mn[0] = min(mn[0], model->points[i].x); mx[0] = max(mx[0], model->points[i].x);
+		mn[1] = min(mn[1], model->points[i].y); mx[1] = max(mx[1], model->points[i].y);
+		mn[2] = min(mn[2], model->points[i].z); mx[2] = max(mx[2], model->points[i].z);
+	}
+
+	field = new DistanceField;
+	field->mapped = 0;
+	field->size = sizeof(FieldHeader)+model->n*sizeof(CvPoint3D32f);
+	h = (FieldHeader *) malloc(sizeof(FieldHeader));
+	memcpy(h->magic, FIELD_MAGIC, 8);
+	h->n = model->n;
+	h->resolution = resolution;
+	h->nx = cvCeil((mx[0]-mn[0]+2.0f*margin)/resolution)+1;
+	h->ny = cvCeil((mx[1]-mn[1]+2.0f*margin)/resolution)+1;
+	h->nz = cvCeil((mx[2]-mn[2]+2.0f*margin)/resolution)+1;
+	for(i=0; i < 3; i++)
+		h->origin[i] = mn[i]-margin;
+	field->header = h;
+	field->size += (size_t)h->nx*h->ny*h->nz*sizeof(uint16_t);
+
+	field->points = (CvPoint3D32f *) malloc(h->n*sizeof(CvPoint3D32f));
+	memcpy(field->points, model->points, h->n*sizeof(CvPoint3D32f));
+	field->index = (uint16_t *) malloc((size_t)h->nx*h->ny*h->nz*sizeof(uint16_t));
+
+	for(z=0, k=0; z < h->nz; z++)
+		for(y=0; y < h->ny; y++)
+			for(x=0; x < h->nx; x++, k++) {
+				q.x = h->origin[0]+x*resolution;
+				q.y = h->origin[1]+y*resolution;
+				q.z = h->origin[2]+z*resolution;
+				i = kdtree_nearest(model, &q, &d2);
+				field->index[k] = d2 <= margin*margin ? i : FIELD_NONE;
+			}
+
+	return field;
+}
+
+int field_save(const DistanceField *field, const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	FieldHeader *h = field->header;
+	int ok;
+
+	if(!file)
+		return 0;
+
+	ok = fwrite(h, sizeof(FieldHeader), 1, file) == 1;
+	ok = ok && fwrite(field->points, sizeof(CvPoint3D32f), h->n, file) == (size_t)h->n;
+	ok = ok && fwrite(field->index, sizeof(uint16_t), (size_t)h->nx*h->ny*h->nz, file) == (size_t)h->nx*h->ny*h->nz;
+	ok = !fclose(file) && ok;
+
+	return ok;
+}
+
+// The file is mapped read-only; pages are loaded on first access and shared between processes
+DistanceField *field_load(const char *filename) {
+	DistanceField *field;
+	FieldHeader *h;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &st) || (size_t)st.st_size < sizeof(FieldHeader)) {
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+		return NULL;
+
+	h = (FieldHeader *) data;
+	if(memcmp(h->magic, FIELD_MAGIC, 8) || h->n < 1 || h->n >= FIELD_NONE || h->nx < 1 || h->ny < 1 || h->nz < 1 ||
+	   (size_t)st.st_size != sizeof(FieldHeader)+h->n*sizeof(CvPoint3D32f)+(size_t)h->nx*h->ny*h->nz*sizeof(uint16_t)) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+
+	field = new DistanceField;
+	field->mapped = 1;
+	field->size = st.st_size;
+	field->header = h;
+	field->points = (CvPoint3D32f *) (h+1);
+	field->index = (uint16_t *) (field->points+h->n);
+
+	return field;
+}
+
+void field_release(DistanceField **field) {
+	if(!*field)
+		return;
+
+	if((*field)->mapped)
+		munmap((*field)->header, (*field)->size);
+	else {
+		free((*field)->header);
+		free((*field)->points);
+		free((*field)->index);
+	}
+	delete *field;
+	*field = NULL;
+}
+
+// Index (in field->points) of the point nearest to the voxel containing q, or -1;
+// d2 receives the exact squared distance to that point
+int field_nearest(const DistanceField *field, const CvPoint3D32f *q, float *d2) {
+	const FieldHeader *h = field->header;
+	int x, y, z, i;
+
+	x = cvRound((q->x-h->origin[0])/h->resolution);
+	y = cvRound((q->y-h->origin[1])/h->resolution);
+	z = cvRound((q->z-h->origin[2])/h->resolution);
+	if(x < 0 || x >= h->nx || y < 0 || y >= h->ny || z < 0 || z >= h->nz)
+		return -1;
+
+	i = field->index[((size_t)z*h->ny+y)*h->nx+x];
+	if(i == FIELD_NONE)
+		return -1;
+
+	*d2 = (field->points[i].x-q->x)*(field->points[i].x-q->x)+(field->points[i].y-q->y)*(field->points[i].y-q->y)+(field->points[i].z-q->z)*(field->points[i].z-q->z);
+	return i;
+}
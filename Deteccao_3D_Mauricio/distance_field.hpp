@@ -0,0 +1,34 @@
+#include <opencv2/opencv.hpp>
+#include <opencv/cv.h>
+#include "kdtree.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Closest point field of a reference model: a voxel grid holding, for each voxel centre,
+// the index of the nearest model point (FIELD_NONE outside the model neighbourhood)
+#define FIELD_MAGIC "FACEDF01"
+#define FIELD_NONE 0xFFFF
+
+// On disk: header, model points, then the voxel indices (x fastest)
+typedef struct {
+	char magic[8];
+	int nx, ny, nz;
+	int n;									// Model points
+	float origin[3];						// Centre of voxel (0,0,0) - in mm
+	float resolution;						// Voxel size - in mm
+} FieldHeader;
+
+typedef struct {
+	FieldHeader *header;
+	CvPoint3D32f *points;
+	uint16_t *index;
+	size_t size;
+	int mapped;								// Memory mapped from a file or allocated by field_build
+} DistanceField;
+
+DistanceField *field_build(const KdTree *model, float resolution, float margin);
+int field_save(const DistanceField *field, const char *filename);
+DistanceField *field_load(const char *filename);
+void field_release(DistanceField **field);
+int field_nearest(const DistanceField *field, const CvPoint3D32f *q, float *d2);
@@ -0,0 +1,221 @@
+#include <fstream>
+#include <sstream>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "kinect.hpp"
+#include "detection.hpp"
+
+using namespace cv;
+using namespace std;
+
+#define PARAMETERS 9
+
+static const char *names[PARAMETERS] = {"resolution", "width", "pose_step", "max_x", "min_y", "max_y", "grid_step", "fill_depth", "max_pose_sum"};
+
+typedef struct {
+	DetectionParams params;
+	double time, recall, fp;
+	int pareto;
+} Configuration;
+
+static double get_parameter(DetectionParams *params, int i) {
+	switch(i) {
+		case 0: return params->resolution;
+		case 1: return params->width;
+		case 2: return params->pose_step;
+		case 3: return params->max_x;
+		case 4: return params->min_y;
+		case 5: return params->max_y;
+		case 6: return params->grid_step;
+		case 7: return params->fill_depth;
+		default: return params->max_pose_sum;
+	}
+}
+
+static void set_parameter(DetectionParams *params, int i, double v) {
+	switch(i) {
+		case 0: params->resolution = v; break;
+		case 1: params->width = v; break;
+		case 2: params->pose_step = (int)v; break;
+		case 3: params->max_x = (int)v; break;
+		case 4: params->min_y = (int)v; break;
+		case 5: params->max_y = (int)v; break;
+		case 6: params->grid_step = (int)v; break;
+		case 7: params->fill_depth = (int)v; break;
+		case 8: params->max_pose_sum = (int)v; break;
+	}
+}
+
+static bool faster(const Configuration &a, const Configuration &b) {
+	return a.time < b.time;
+}
+
+// Accuracy versus speed of detection parameters over an annotated depth dataset.
+// Each line of the list is "depth.pgm;x;y": a 16-bit disparity frame and the face centre in depth
+// pixels (empty for frames without faces). Parameters are swept with name=v1,v2,... arguments.
+int main(int argc, char *argv[]) {
+	int i, j, f, c, n, hits, faces, detections, frontal = 0, index[PARAMETERS];
+	double t, v;
+	string line, path, x, y, value;
+	vector<double> values[PARAMETERS];
+	vector<Mat> frames;
+	vector<Point2d> labels;
+	vector<Vec4d> r;
+	vector<Configuration> configs;
+	Configuration config;
+	DetectionParams params;
+	DetectionContext *ctx;
+
+	if(argc < 3) {
+		cout << "Usage: " << argv[0] << " <list.csv> <output.txt> [frontal] [name=v1,v2,...]" << endl;
+		cout << "Parameters:";
+		for(i=0; i < PARAMETERS; i++)
+			cout << " " << names[i];
+		cout << endl;
+		return -1;
+	}
+
+	for(i=3; i < argc; i++) {
+		if(!strcmp(argv[i], "frontal")) {
+			frontal = 1;
+			continue;
+		}
+		for(j=0; j < PARAMETERS; j++)
+			if(!strncmp(argv[i], names[j], strlen(names[j])) && argv[i][strlen(names[j])] == '=')
+				break;
+		if(j == PARAMETERS) {
+			cout << "Unknown argument: " << argv[i] << endl;
+			return -1;
+		}
+		stringstream list(argv[i]+strlen(names[j])+1);
+		while(getline(list, value, ','))
+			values[j].push_back(atof(value.c_str()));
+	}
+
+	// Default sweep - the settings that change cost without changing the cascade scale
+	if(argc <= 3+frontal) {
+		values[2].push_back(10);
+		values[2].push_back(20);
+		values[3].push_back(0);
+		values[3].push_back(30);
+		values[6].push_back(4);
+		values[6].push_back(6);
+		values[6].push_back(8);
+		values[7].push_back(6);
+		values[7].push_back(10);
+	}
+
+	detection_default_params(&params);
+	for(i=0; i < PARAMETERS; i++)
+		if(values[i].empty())
+			values[i].push_back(get_parameter(&params, i));
+
+	// Load the dataset once
+	ifstream list(argv[1]);
+	ofstream output(argv[2]);
+	if(!list || !output) {
+		cout << "Could not open " << argv[1] << " or write to " << argv[2] << endl;
+		return -1;
+	}
+
+	while(getline(list, line)) {
+		stringstream liness(line);
+		getline(liness, path, ';');
+		if(!getline(liness, x, ';'))
+			x = "";
+		if(!getline(liness, y, ';'))
+			y = "";
+		if(path.empty())
+			continue;
+
+		Mat depth = imread(path, CV_LOAD_IMAGE_ANYDEPTH);
+		if(depth.empty() || depth.type() != CV_16UC1 || depth.rows != HEIGHT || depth.cols != WIDTH) {
+			cerr << path << ": not a " << WIDTH << "x" << HEIGHT << " 16-bit depth frame" << endl;
+			continue;
+		}
+
+		frames.push_back(depth);
+		if(x.empty() || y.empty())
+			labels.push_back(Point2d(-1.0, -1.0));
+		else
+			labels.push_back(Point2d(atof(x.c_str()), atof(y.c_str())));
+	}
+
+	if(frames.empty()) {
+		cout << "No frames in " << argv[1] << endl;
+		return -1;
+	}
+
+	// Every combination of the swept values
+	memset(index, 0, sizeof(index));
+	for(;;) {
+		for(i=0; i < PARAMETERS; i++)
+			set_parameter(&params, i, values[i][index[i]]);
+
+		if(params.width*params.resolution > 2*FACE_SIZE && params.pose_step > 0 && params.grid_step > 0 && params.fill_depth > 0 && params.fill_depth < 255 &&
+		   detection_pose_count(&params) <= MAX_POSES) {
+			ctx = detection_create(&params);
+
+			t = 0.0;
+			hits = faces = detections = 0;
+			for(f=0; f < (int)frames.size(); f++) {
+				v = (double)getTickCount();
+				r = frontal ? frontal_face_detection(ctx, frames[f]) : face_detection(ctx, frames[f]);
+				t += (double)getTickCount()-v;
+
+				// A detection hits the face if the annotated centre lies inside its box
+				n = 0;
+				for(c=0; c < (int)r.size(); c++)
+					if(labels[f].x >= 0.0 && fabs(r[c][0]-labels[f].x) <= r[c][2] && fabs(r[c][1]-labels[f].y) <= r[c][2])
+						n++;
+				faces += labels[f].x >= 0.0;
+				hits += n > 0;
+				detections += r.size()-n;
+			}
+
+			detection_release(&ctx);
+
+			config.params = params;
+			config.time = t*1000.0/getTickFrequency()/frames.size();
+			config.recall = faces ? (double)hits/faces : 0.0;
+			config.fp = (double)detections/frames.size();
+			configs.push_back(config);
+
+			cout << configs.size() << ": " << config.time << " ms, recall " << config.recall << ", " << config.fp << " false positives per frame" << endl;
+		}
+
+		for(i=0; i < PARAMETERS && ++index[i] == (int)values[i].size(); i++)
+			index[i] = 0;
+		if(i == PARAMETERS)
+			break;
+	}
+
+	sort(configs.begin(), configs.end(), faster);
+
+	// Pareto front - no other configuration is both faster and more accurate
+	for(i=0; i < (int)configs.size(); i++) {
+		configs[i].pareto = 1;
+		for(j=0; j < (int)configs.size() && configs[i].pareto; j++)
+			if(configs[j].time <= configs[i].time && configs[j].recall >= configs[i].recall && (configs[j].time < configs[i].time || configs[j].recall > configs[i].recall))
+				configs[i].pareto = 0;
+	}
+
+	for(i=0; i < PARAMETERS; i++)
+		output << names[i] << " ";
+	output << "time_ms recall fp_per_frame pareto" << endl;
+	for(c=0; c < (int)configs.size(); c++) {
+		for(i=0; i < PARAMETERS; i++)
+			output << get_parameter(&configs[c].params, i) << " ";
+		output << configs[c].time << " " << configs[c].recall << " " << configs[c].fp << " " << configs[c].pareto << endl;
+	}
+
+	cout << endl << "Pareto front:" << endl;
+	for(c=0; c < (int)configs.size(); c++)
+		if(configs[c].pareto) {
+			for(i=0; i < PARAMETERS; i++)
+				cout << names[i] << "=" << get_parameter(&configs[c].params, i) << " ";
+			cout << "-> " << configs[c].time << " ms, recall " << configs[c].recall << endl;
+		}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#include "normalization.hpp"
+
+// Builds the distance field of a normalization reference model; the field is loaded
+// (memory mapped) by normalization_model instead of the range image
+int main(int argc, char *argv[]) {
+	int64 t;
+
+	if(argc < 3) {
+		cout << "Usage: " << argv[0] << " <model.pgm> <model.field>" << endl;
+		return -1;
+	}
+
+	t = getTickCount();
+	if(!normalization_field(argv[1], argv[2])) {
+		cout << "Could not build " << argv[2] << " from " << argv[1] << endl;
+		return -1;
+	}
+
+	cout << argv[2] << " built in " << (getTickCount()-t)*1000.0/getTickFrequency() << " ms" << endl;
+
+	return 0;
+}
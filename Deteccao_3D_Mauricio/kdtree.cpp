@@ -0,0 +1,107 @@
+#include "kdtree.hpp"
+
+static float coordinate(const CvPoint3D32f *p, int axis) {
+	return axis == 0 ? p->x : (axis == 1 ? p->y : p->z);
+}
+
+class AxisLess {
+public:
+	AxisLess(int axis) : axis(axis) {}
+	bool operator()(const CvPoint3D32f &a, const CvPoint3D32f &b) const {
+		return coordinate(&a, axis) < coordinate(&b, axis);
+	}
+
+private:
+	int axis;
+};
+
+// Split [lo,hi) at the median of the axis with the largest spread
+static void build(KdTree *tree, int lo, int hi) {
+	int i, a, mid;
+	float mn[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, mx[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX}, v;
+
+	if(hi-lo < 1)
+		return;
+
+	for(i=lo; i < hi; i++)
+		for(a=0; a < 3; a++) {
+			v = coordinate(&tree->points[i], a);
+			mn[a] = min(mn[a], v);
+			mx[a] = max(mx[a], v);
+		}
+
+	a = 0;
+	if(mx[1]-mn[1] > mx[a]-mn[a])
+		a = 1;
+	if(mx[2]-mn[2] > mx[a]-mn[a])
+		a = 2;
+
+	mid = (lo+hi)/2;
+	nth_element(tree->points+lo, tree->points+mid, tree->points+hi, AxisLess(a));
+	tree->axis[mid] = a;
+
+	build(tree, lo, mid);
+	build(tree, mid+1, hi);
+}
+
+KdTree *kdtree_build(const CvPoint3D32f *points, int n) {
+	KdTree *tree = new KdTree;
+
+	tree->n = n;
+	tree->points = (CvPoint3D32f *) malloc(n*sizeof(CvPoint3D32f));
+	tree->axis = (uchar *) malloc(n*sizeof(uchar));
+	memcpy(tree->points, points, n*sizeof(CvPoint3D32f));
+	build(tree, 0, n);
+
+	return tree;
+}
+
+void kdtree_release(KdTree **tree) {
+	if(!*tree)
+		return;
+
+	free((*tree)->points);
+	free((*tree)->axis);
+	delete *tree;
+	*tree = NULL;
+}
+
+static void search(const KdTree *tree, int lo, int hi, const CvPoint3D32f *q, int *best, float *d2) {
+	int mid;
+	float d, dx, dy, dz;
+
+	if(hi-lo < 1)
+		return;
+
+	mid = (lo+hi)/2;
+	dx = tree->points[mid].x-q->x;
+	dy = tree->points[mid].y-q->y;
+	dz = tree->points[mid].z-q->z;
+	d = dx*dx+dy*dy+dz*dz;
+	if(d < *d2) {
+		*d2 = d;
+		*best = mid;
+	}
+
+	// Near side first; the far side only if the splitting plane is closer than the best match
+	d = coordinate(q, tree->axis[mid])-coordinate(&tree->points[mid], tree->axis[mid]);
+	if(d < 0.0f) {
+		search(tree, lo, mid, q, best, d2);
+		if(d*d < *d2)
+			search(tree, mid+1, hi, q, best, d2);
+	}
+	else {
+		search(tree, mid+1, hi, q, best, d2);
+		if(d*d < *d2)
+			search(tree, lo, mid, q, best, d2);
+	}
+}
+
+// Index (in tree->points) of the point nearest to q; d2 receives the squared distance
+int kdtree_nearest(const KdTree *tree, const CvPoint3D32f *q, float *d2) {
+	int best = -1;
+
+	*d2 = FLT_MAX;
+	search(tree, 0, tree->n, q, &best, d2);
+	return best;
+}
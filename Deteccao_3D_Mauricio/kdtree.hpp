@@ -0,0 +1,16 @@
+#include <opencv2/opencv.hpp>
+#include <opencv/cv.h>
+
+using namespace cv;
+using namespace std;
+
+// Static 3D k-d tree; points are reordered so each subtree is a contiguous range split at its median
+typedef struct {
+	int n;
+	CvPoint3D32f *points;
+	uchar *axis;							// Split axis of the node stored at each position
+} KdTree;
+
+KdTree *kdtree_build(const CvPoint3D32f *points, int n);
+void kdtree_release(KdTree **tree);
+int kdtree_nearest(const KdTree *tree, const CvPoint3D32f *q, float *d2);
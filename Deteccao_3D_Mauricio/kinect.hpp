@@ -19,11 +19,40 @@
 #define DEPTH_THRESHOLD 875					// Maximum disparity value
 
 // Detection parameters
+#define CASCADE_FILE "ALL_Spring2003_3D.xml"	// Haar (legacy) or LBP (traincascade) cascade
+#define LBP_SCALE 1.5						// Gray levels per projection unit of LBP cascade input
 #define X_WIDTH 1800.0						// Orthogonal projection width - in mm
 #define Y_WIDTH 1600.0						// Orthogonal projection height - in mm
 #define RESOLUTION 0.127272727				// Resolution in pixels per mm
 #define FACE_SIZE 21						// Face size - 165*RESOLUTION
 #define FACE_HALF_SIZE 10					// (165*RESOLUTION)/2
+#define SCAN_STRIDE 2						// Coarse window scan stride - in pixels
+#define SCAN_REFINE_STAGE 3					// Stages a coarse window must pass to be densely refined
+#define SCAN_TILE_WIDTH 32					// Scan tile width - in windows (keeps integral rows in L1)
+#define SCAN_TILE_HEIGHT 32					// Scan tile height - in windows
+#define MAX_CANDIDATES 1000					// Face windows kept per frame before merging
+#define MAX_POSES 40						// Poses face_detection may scan (25 windows each)
+#define GRID_STEP 6							// Depth sampling step - in pixels
+#define GRID_WIDTH 107						// Sampled grid width - ceil(WIDTH/GRID_STEP)
+#define GRID_HEIGHT 80						// Sampled grid height - ceil(HEIGHT/GRID_STEP)
+
+// Background model parameters
+#define BACKGROUND_ALPHA 0.02				// Learning rate for background samples
+#define BACKGROUND_SLOW_ALPHA 0.0005		// Learning rate for static foreground samples
+#define BACKGROUND_SIGMA 3.0				// Foreground threshold - in standard deviations
+#define BACKGROUND_MIN_STDDEV 2.0			// Minimum standard deviation - in disparity units
+#define BACKGROUND_WARMUP 30				// Observations before a sample can be background
+
+// Frame change gate parameters
+#define GATE_STEP 8							// Downsampling step - in pixels
+#define GATE_WIDTH 80						// Downsampled width - WIDTH/GATE_STEP
+#define GATE_HEIGHT 60						// Downsampled height - HEIGHT/GATE_STEP
+#define GATE_BLOCK 8						// Block size - in downsampled pixels
+#define GATE_BLOCKS_X 10					// ceil(GATE_WIDTH/GATE_BLOCK)
+#define GATE_BLOCKS_Y 8						// ceil(GATE_HEIGHT/GATE_BLOCK)
+#define GATE_CLAMP 32						// Maximum absolute difference counted per pixel
+#define GATE_THRESHOLD 4.0					// Mean absolute difference that marks a block as changed
+#define GATE_REFRESH 15						// Maximum frames a cached detection is reused
 
 // Normalization parameters
 #define MODEL_WIDTH 48.0
@@ -0,0 +1,129 @@
+#include "lbp_cascade.hpp"
+#include "kinect.hpp"
+
+#define LBP_FIXED 65536.0					// Fixed point scale of leaves and thresholds
+#define LBP_THRESHOLD_EPS 1e-5				// Same tolerance applied by cv::CascadeClassifier
+
+// Load a traincascade LBP cascade; returns NULL for any other kind of cascade, or if its window
+// is not the FACE_SIZE x FACE_SIZE window the detector scans
+LbpCascade *lbp_cascade_load(const char *filename) {
+	FileStorage fs(filename, FileStorage::READ);
+	FileNode root, node;
+	FileNodeIterator it, wt;
+	LbpCascade *cascade;
+	LbpStage stage;
+	LbpWeakClassifier weak;
+	vector<int> nodes, rect;
+	vector<float> leaves;
+	int i;
+
+	if(!fs.isOpened())
+		return NULL;
+
+	root = fs.getFirstTopLevelNode();
+	if((string)root["featureType"] != "LBP")
+		return NULL;
+
+	// Features outside the scanned window would read past it
+	if((int)root["width"] != FACE_SIZE || (int)root["height"] != FACE_SIZE) {
+		fprintf(stderr, "%s: window is %dx%d, the detector needs %dx%d (train with -w %d -h %d)\n", filename,
+			(int)root["width"], (int)root["height"], FACE_SIZE, FACE_SIZE, FACE_SIZE, FACE_SIZE);
+		return NULL;
+	}
+
+	cascade = new LbpCascade;
+	cascade->width = (int)root["width"];
+	cascade->height = (int)root["height"];
+	cascade->sum = NULL;
+	cascade->step = 0;
+
+	node = root["features"];
+	for(it=node.begin(); it != node.end(); ++it) {
+		(*it)["rect"] >> rect;
+		cascade->features.push_back(Rect(rect[0], rect[1], rect[2], rect[3]));
+	}
+
+	node = root["stages"];
+	for(it=node.begin(); it != node.end(); ++it) {
+		stage.first = cascade->classifiers.size();
+		stage.threshold = cvFloor(((float)(*it)["stageThreshold"]-LBP_THRESHOLD_EPS)*LBP_FIXED);
+
+		for(wt=(*it)["weakClassifiers"].begin(); wt != (*it)["weakClassifiers"].end(); ++wt) {
+			(*wt)["internalNodes"] >> nodes;
+			(*wt)["leafValues"] >> leaves;
+
+			// Only stumps (one split, 256 categories) are supported
+			if(nodes.size() != 11 || leaves.size() != 2) {
+				fprintf(stderr, "%s: only LBP stumps are supported\n", filename);
+				delete cascade;
+				return NULL;
+			}
+
+			weak.feature = nodes[2];
+			for(i=0; i < 8; i++)
+				weak.subset[i] = nodes[3+i];
+			weak.leaf[0] = cvRound(leaves[0]*LBP_FIXED);
+			weak.leaf[1] = cvRound(leaves[1]*LBP_FIXED);
+			cascade->classifiers.push_back(weak);
+		}
+
+		stage.count = cascade->classifiers.size()-stage.first;
+		cascade->stages.push_back(stage);
+	}
+	cascade->count = cascade->stages.size();
+
+	return cascade;
+}
+
+void lbp_cascade_release(LbpCascade **cascade) {
+	delete *cascade;
+	*cascade = NULL;
+}
+
+// Precompute the integral offsets of every feature for a 32-bit integral image
+void lbp_cascade_set_image(LbpCascade *cascade, const IplImage *sum) {
+	int f, r, c;
+	Rect *rc;
+
+	cascade->sum = (const int *) sum->imageData;
+	cascade->step = sum->widthStep/sizeof(int);
+
+	cascade->offsets.resize(16*cascade->features.size());
+	for(f=0; f < (int)cascade->features.size(); f++) {
+		rc = &cascade->features[f];
+		for(r=0; r < 4; r++)
+			for(c=0; c < 4; c++)
+				cascade->offsets[16*f+4*r+c] = (rc->y+r*rc->height)*cascade->step+rc->x+c*rc->width;
+	}
+}
+
+#define CELL(p, o, a, b, c, d) ((p)[(o)[a]]-(p)[(o)[b]]-(p)[(o)[c]]+(p)[(o)[d]])
+
+// Evaluate the window at row i and column j - integer only
+// Returns 1 if all stages passed, -s if rejected at stage s (as cvRunHaarClassifierCascade)
+int lbp_cascade_run(const LbpCascade *cascade, int i, int j) {
+	const int *p = cascade->sum+i*cascade->step+j, *o;
+	const LbpWeakClassifier *weak;
+	int s, w, sum, center, code;
+
+	for(s=0; s < cascade->count; s++) {
+		weak = &cascade->classifiers[cascade->stages[s].first];
+		for(w=0, sum=0; w < cascade->stages[s].count; w++, weak++) {
+			o = &cascade->offsets[16*weak->feature];
+			center = CELL(p, o, 5, 6, 9, 10);
+			code = (CELL(p, o, 0, 1, 4, 5) >= center ? 128 : 0) |
+				(CELL(p, o, 1, 2, 5, 6) >= center ? 64 : 0) |
+				(CELL(p, o, 2, 3, 6, 7) >= center ? 32 : 0) |
+				(CELL(p, o, 6, 7, 10, 11) >= center ? 16 : 0) |
+				(CELL(p, o, 10, 11, 14, 15) >= center ? 8 : 0) |
+				(CELL(p, o, 9, 10, 13, 14) >= center ? 4 : 0) |
+				(CELL(p, o, 8, 9, 12, 13) >= center ? 2 : 0) |
+				(CELL(p, o, 4, 5, 8, 9) >= center ? 1 : 0);
+			sum += weak->leaf[((unsigned)weak->subset[code>>5] & (1u << (code & 31))) ? 0 : 1];
+		}
+		if(sum < cascade->stages[s].threshold)
+			return -s;
+	}
+
+	return 1;
+}
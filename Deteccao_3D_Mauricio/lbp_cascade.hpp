@@ -0,0 +1,33 @@
+#include <opencv2/opencv.hpp>
+#include <opencv/cv.h>
+
+using namespace cv;
+using namespace std;
+
+// Boosted stumps over LBP features, as written by opencv_traincascade -featureType LBP
+typedef struct {
+	int feature;							// Feature index
+	int subset[8];							// Categories (LBP codes) sent to the first leaf
+	int leaf[2];							// Leaf values - fixed point
+} LbpWeakClassifier;
+
+typedef struct {
+	int first;								// First weak classifier
+	int count;								// Number of weak classifiers
+	int threshold;							// Stage threshold - fixed point
+} LbpStage;
+
+typedef struct {
+	int width, height, count;				// Window size and number of stages
+	vector<LbpStage> stages;
+	vector<LbpWeakClassifier> classifiers;
+	vector<Rect> features;					// Cell of each feature, 3x3 cells per feature
+	vector<int> offsets;					// 4x4 integral offsets per feature for the current image
+	const int *sum;
+	int step;
+} LbpCascade;
+
+LbpCascade *lbp_cascade_load(const char *filename);
+void lbp_cascade_release(LbpCascade **cascade);
+void lbp_cascade_set_image(LbpCascade *cascade, const IplImage *sum);
+int lbp_cascade_run(const LbpCascade *cascade, int i, int j);
@@ -1,55 +1,80 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
-#include <libfreenect_sync.h>
 #include "kinect.hpp"
+#include "acquisition.hpp"
 #include "detection.hpp"
+#include "stage_statistics.hpp"
+#include "normalization.hpp"
 
 using namespace cv;
 using namespace std;
 
+// Display colour of each depth value: yellow to red up to 1023, red to black beyond, black without data
+static void depth_colors(Vec3b lut[DEPTH_RANGE]) {
+	for(int d=0; d < DEPTH_RANGE; d++) {
+		if(d >= 2047)
+			lut[d] = Vec3b(0, 0, 0);
+		else if(d < 1024)
+			lut[d] = Vec3b(0, (uchar)(255-(d/1023.0)*255.0), 255);
+		else
+			lut[d] = Vec3b(0, 0, (uchar)(((d-1024)/1023.0)*255.0));
+	}
+}
+
 int main(int argc, char *argv[]) {
 	int camera_id;
 	uint32_t timestamp;
-	uint16_t *depth_data, *buffer;
+	uint16_t *buffer;
+	Vec3b lut[DEPTH_RANGE];
 	vector<Vec4d> faces;
+	int normalize = 0;
+	Mat range;
 
 	if(argc > 1)
 		camera_id = atoi(argv[1]);
 	else
 		camera_id = 0;
 
+	// Detector options
+	for(int i=2; i < argc; i++) {
+		if(!strcmp(argv[i], "bg"))			// Fixed sensor: ignore static background
+			detection_background(NULL, 1);
+		else if(!strcmp(argv[i], "gate"))	// Reuse detections on static frames
+			detection_gate(NULL, 1);
+		else if(!strcmp(argv[i], "mt"))		// Distribute scan tiles to worker threads
+			parallel_scan_enable(1);
+		else if(!strcmp(argv[i], "stats"))	// Record cascade stage statistics
+			stage_statistics_open("stage_statistics.txt");
+		else if(strstr(argv[i], ".xml"))	// Haar or LBP depth cascade
+			detection_cascade(argv[i]);
+		else if(!strcmp(argv[i], "norm"))	// Show the normalized range image of the first face
+			normalize = 1;
+		else if(strstr(argv[i], ".pgm") || strstr(argv[i], ".field"))	// Normalization reference model
+			if(!normalization_model(argv[i]))
+				cout << "Could not load the normalization model " << argv[i] << endl;
+	}
+
 	// Initialize Kinect
-	freenect_sync_get_depth((void **) &buffer, &timestamp, camera_id, FREENECT_DEPTH_11BIT);
-	depth_data = new uint16_t[SIZE];
-	Mat depth(HEIGHT, WIDTH, CV_16UC1, depth_data, WIDTH*sizeof(uint16_t));
-	Mat vis(depth.size(), CV_8UC3);
+	if(!acquisition_start(camera_id)) {
+		cout << "Could not open Kinect " << camera_id << endl;
+		return -1;
+	}
+	depth_colors(lut);
+	Mat depth;
+	Mat vis(HEIGHT, WIDTH, CV_8UC3);
 
 	// Video loop
 	for(;;) {
-		// Capture new frame
-		freenect_sync_get_depth((void **) &buffer, &timestamp, camera_id, FREENECT_DEPTH_11BIT);
-		memcpy(depth_data, buffer, SIZE*sizeof(uint16_t));
+		// Capture new frame - used in place, the driver already wrote it
+		buffer = acquisition_depth(&timestamp);
+		if(!buffer)
+			break;
+		depth = Mat(HEIGHT, WIDTH, CV_16UC1, buffer, WIDTH*sizeof(uint16_t));
 
 		// BEGIN: Visualization
-		for(int i=0; i < depth.rows; i++)
-			for(int j=0; j < depth.cols; j++) {
-				if(depth.at<uint16_t>(i,j) < 2047) {
-					vis.at<Vec3b>(i,j)[0] = 0;
-					if(depth.at<uint16_t>(i,j) < 1024) {
-						vis.at<Vec3b>(i,j)[1] = 255-(depth.at<uint16_t>(i,j)/1023.0)*255.0;
-						vis.at<Vec3b>(i,j)[2] = 255;
-					}
-					else {
-						vis.at<Vec3b>(i,j)[1] = 0;
-						vis.at<Vec3b>(i,j)[2] = ((depth.at<uint16_t>(i,j)-1024)/1023.0)*255.0;
-					}
-				}
-				else {
-					vis.at<Vec3b>(i,j)[0] = 0;
-					vis.at<Vec3b>(i,j)[1] = 0;
-					vis.at<Vec3b>(i,j)[2] = 0;
-				}
-			}
+		Vec3b *color = vis.ptr<Vec3b>(0);
+		for(int k=0; k < SIZE; k++)
+			color[k] = lut[buffer[k] & (DEPTH_RANGE-1)];
 		// END: Visualization
 
 
@@ -61,11 +86,25 @@ int main(int argc, char *argv[]) {
 
 		imshow("3D Face Detection Demo", vis);
 
-		if(waitKey(1) == 27)
+		if(normalize && faces.size()) {
+			range = face_normalization(depth, faces[0]);
+			if(!range.empty())
+				imshow("Normalized Face", range*(65535.0/MAX_DEPTH_VALUE));
+		}
+
+		int key = waitKey(1);
+		if(key == 27)
 			break;
+		// Save the normalized face (e.g. as a reference model)
+		if(key == 's' && !range.empty())
+			imwrite("normalized.pgm", range);
 	}
 
-	freenect_sync_stop();
+	acquisition_stop();
+	stage_statistics_close();
+
+	cout << "Skipped frames: " << detection_skip_rate(NULL)*100.0 << "%" << endl;
+	cout << "Dropped frames: " << acquisition_dropped() << endl;
 
 	return 0;
 }
@@ -0,0 +1,271 @@
+#include "normalization.hpp"
+#include "distance_field.hpp"
+#include "kinect.hpp"
+
+#define RANGE_WIDTH ((int)(2*MODEL_WIDTH/MODEL_RESOLUTION)+1)
+#define RANGE_HEIGHT ((int)((MODEL_HEIGHT_1+MODEL_HEIGHT_2)/MODEL_RESOLUTION)+1)
+#define RANGE_OFFSET 250.0					// Range image base plane - in mm behind the nose tip
+#define RANGE_SCALE 10.0					// Range image units per mm
+#define CROP_RADIUS 120.0					// Face cloud radius around the detection - in mm
+#define NOSE_RADIUS 40.0					// Nose tip search radius - in mm
+#define MIN_FACE_POINTS 200					// Smaller clouds are not normalized
+#define ICP_COARSE_ITERATIONS 10			// Iterations with a 4x wider outlier threshold
+#define ICP_EPSILON 1e-3					// Translation change that stops ICP - in mm
+#define FIELD_MARGIN (4.0*OUTLIER_THRESHOLD)	// Distance field extent around the model (coarse ICP threshold) - in mm
+
+static KdTree *model = NULL;
+static DistanceField *field = NULL;
+
+// Model points of a normalized range image
+static int model_points(const char *filename, vector<CvPoint3D32f> &points) {
+	Mat img = imread(filename, CV_LOAD_IMAGE_ANYDEPTH);
+	CvPoint3D32f pt;
+	int i, j;
+
+	if(img.empty() || img.type() != CV_16UC1 || img.rows != RANGE_HEIGHT || img.cols != RANGE_WIDTH)
+		return 0;
+
+	for(i=0; i < img.rows; i++)
+		for(j=0; j < img.cols; j++)
+			if(img.at<uint16_t>(i,j)) {
+				pt.x = j*MODEL_RESOLUTION-MODEL_WIDTH;
+				pt.y = MODEL_HEIGHT_1-i*MODEL_RESOLUTION;
+				pt.z = img.at<uint16_t>(i,j)/RANGE_SCALE-RANGE_OFFSET;
+				points.push_back(pt);
+			}
+
+	return points.size() >= MIN_FACE_POINTS;
+}
+
+// Reference model from a normalized range image (k-d tree) or a precomputed distance field
+int normalization_model(const char *filename) {
+	vector<CvPoint3D32f> points;
+	DistanceField *f;
+
+	if(strstr(filename, ".field")) {
+		f = field_load(filename);
+		if(!f)
+			return 0;
+		field_release(&field);
+		kdtree_release(&model);
+		field = f;
+		return 1;
+	}
+
+	if(!model_points(filename, points))
+		return 0;
+
+	field_release(&field);
+	kdtree_release(&model);
+	model = kdtree_build(&points[0], points.size());
+
+	return 1;
+}
+
+// Offline distance field of a normalized range image at MODEL_RESOLUTION
+int normalization_field(const char *model_file, const char *field_file) {
+	vector<CvPoint3D32f> points;
+	KdTree *tree;
+	DistanceField *f;
+	int ok;
+
+	if(!model_points(model_file, points))
+		return 0;
+
+	tree = kdtree_build(&points[0], points.size());
+	f = field_build(tree, MODEL_RESOLUTION, FIELD_MARGIN);
+	kdtree_release(&tree);
+	if(!f)
+		return 0;
+
+	ok = field_save(f, field_file);
+	field_release(&f);
+
+	return ok;
+}
+
+// Model point nearest to q, from the field (one lookup) or the k-d tree; -1 if there is none
+static int nearest(const CvPoint3D32f *q, float *d2, CvPoint3D32f *p) {
+	int k;
+
+	if(field) {
+		k = field_nearest(field, q, d2);
+		if(k >= 0)
+			*p = field->points[k];
+	}
+	else {
+		k = kdtree_nearest(model, q, d2);
+		*p = model->points[k];
+	}
+
+	return k;
+}
+
+// Face points in mm (x right, y up, z towards the camera) around the detection
+static void face_cloud(Mat &depth, Vec4d &face, vector<CvPoint3D32f> &cloud) {
+	int i, j, i0, i1, j0, j1, l, n;
+	double z, c[3], d[25];
+	CvPoint3D32f pt;
+
+	cloud.clear();
+
+	// Centre depth - median of a 5x5 neighbourhood
+	for(i=-2, n=0; i <= 2; i++)
+		for(j=-2; j <= 2; j++) {
+			l = depth.at<uint16_t>(min(max(cvRound(face[1])+i, 0), HEIGHT-1), min(max(cvRound(face[0])+j, 0), WIDTH-1));
+			if(l < DEPTH_THRESHOLD)
+				d[n++] = DEPTH_Z3*tan(l/DEPTH_Z2+DEPTH_Z1);
+		}
+	if(!n)
+		return;
+	sort(d, d+n);
+	z = d[n/2];
+	c[0] = (face[0]-DEPTH_CX)/DEPTH_FX*z;
+	c[1] = -(face[1]-DEPTH_CY)/DEPTH_FY*z;
+	c[2] = -z;
+
+	i0 = max(0, cvFloor(face[1]-2.0*face[2]));
+	i1 = min(HEIGHT-1, cvCeil(face[1]+2.0*face[2]));
+	j0 = max(0, cvFloor(face[0]-2.0*face[2]));
+	j1 = min(WIDTH-1, cvCeil(face[0]+2.0*face[2]));
+	for(i=i0; i <= i1; i++)
+		for(j=j0; j <= j1; j++) {
+			l = depth.at<uint16_t>(i,j);
+			if(l >= DEPTH_THRESHOLD)
+				continue;
+			z = DEPTH_Z3*tan(l/DEPTH_Z2+DEPTH_Z1);
+			pt.x = (j-DEPTH_CX)/DEPTH_FX*z;
+			pt.y = -(i-DEPTH_CY)/DEPTH_FY*z;
+			pt.z = -z;
+			if(pow(pt.x-c[0], 2.0)+pow(pt.y-c[1], 2.0)+pow(pt.z-c[2], 2.0) < CROP_RADIUS*CROP_RADIUS)
+				cloud.push_back(pt);
+		}
+
+	// Nose tip - closest point to the camera near the centre
+	for(i=0, l=-1; i < (int)cloud.size(); i++)
+		if(pow(cloud[i].x-c[0], 2.0)+pow(cloud[i].y-c[1], 2.0) < NOSE_RADIUS*NOSE_RADIUS && (l < 0 || cloud[i].z > cloud[l].z))
+			l = i;
+	if(l < 0) {
+		cloud.clear();
+		return;
+	}
+
+	pt = cloud[l];
+	for(i=0; i < (int)cloud.size(); i++) {
+		cloud[i].x -= pt.x;
+		cloud[i].y -= pt.y;
+		cloud[i].z -= pt.z;
+	}
+}
+
+// Rigid alignment of the cloud to the model (point-to-point ICP); the cloud is transformed in place
+static void icp(vector<CvPoint3D32f> &cloud) {
+	int i, k, it, n;
+	float d2, thr;
+	double cp[3], cq[3], h[9], r[9], t[3], x, y, z;
+	CvPoint3D32f q;
+
+	for(it=0; it < MAX_ICP_ITERATIONS; it++) {
+		thr = it < ICP_COARSE_ITERATIONS ? 16.0*OUTLIER_SQUARED_THRESHOLD : OUTLIER_SQUARED_THRESHOLD;
+
+		// Correspondences and centroids
+		memset(cp, 0, sizeof(cp));
+		memset(cq, 0, sizeof(cq));
+		memset(h, 0, sizeof(h));
+		for(i=0, n=0; i < (int)cloud.size(); i++) {
+			k = nearest(&cloud[i], &d2, &q);
+			if(k < 0 || d2 > thr)
+				continue;
+			cp[0] += cloud[i].x; cp[1] += cloud[i].y; cp[2] += cloud[i].z;
+			cq[0] += q.x; cq[1] += q.y; cq[2] += q.z;
+			h[0] += cloud[i].x*q.x; h[1] += cloud[i].x*q.y; h[2] += cloud[i].x*q.z;
+			h[3] += cloud[i].y*q.x; h[4] += cloud[i].y*q.y; h[5] += cloud[i].y*q.z;
+			h[6] += cloud[i].z*q.x; h[7] += cloud[i].z*q.y; h[8] += cloud[i].z*q.z;
+			n++;
+		}
+		if(n < 3)
+			break;
+
+		for(i=0; i < 3; i++) {
+			cp[i] /= n;
+			cq[i] /= n;
+		}
+		for(i=0; i < 9; i++)
+			h[i] -= n*cp[i/3]*cq[i%3];
+
+		// Best rotation from the SVD of the cross-covariance (Kabsch)
+		Mat H(3, 3, CV_64F, h), w, u, vt;
+		SVD::compute(H, w, u, vt);
+		Mat R = vt.t()*u.t();
+		if(determinant(R) < 0.0) {
+			for(i=0; i < 3; i++)
+				vt.at<double>(2,i) = -vt.at<double>(2,i);
+			R = vt.t()*u.t();
+		}
+		for(i=0; i < 9; i++)
+			r[i] = R.at<double>(i/3, i%3);
+		for(i=0; i < 3; i++)
+			t[i] = cq[i]-(r[i*3]*cp[0]+r[i*3+1]*cp[1]+r[i*3+2]*cp[2]);
+
+		for(i=0; i < (int)cloud.size(); i++) {
+			x = cloud[i].x;
+			y = cloud[i].y;
+			z = cloud[i].z;
+			cloud[i].x = r[0]*x+r[1]*y+r[2]*z+t[0];
+			cloud[i].y = r[3]*x+r[4]*y+r[5]*z+t[1];
+			cloud[i].z = r[6]*x+r[7]*y+r[8]*z+t[2];
+		}
+
+		if(sqrt(t[0]*t[0]+t[1]*t[1]+t[2]*t[2]) < ICP_EPSILON && r[0]+r[4]+r[8] > 3.0-1e-8)
+			break;
+	}
+}
+
+// Normalized range image of a detected face (empty if the face has too few points)
+Mat face_normalization(Mat &depth, Vec4d &face) {
+	vector<CvPoint3D32f> cloud;
+	Mat range, filled;
+	int i, j, k, r, c, n;
+	double s;
+
+	face_cloud(depth, face, cloud);
+	if(cloud.size() < MIN_FACE_POINTS)
+		return Mat();
+
+	// Without a model only the nose tip is aligned
+	if(model || field)
+		icp(cloud);
+
+	// Resample - the point nearest to the camera wins
+	range = Mat::zeros(RANGE_HEIGHT, RANGE_WIDTH, CV_32FC1);
+	for(k=0; k < (int)cloud.size(); k++) {
+		r = cvRound((MODEL_HEIGHT_1-cloud[k].y)/MODEL_RESOLUTION);
+		c = cvRound((cloud[k].x+MODEL_WIDTH)/MODEL_RESOLUTION);
+		s = cloud[k].z+RANGE_OFFSET;
+		if(r >= 0 && r < RANGE_HEIGHT && c >= 0 && c < RANGE_WIDTH && s > range.at<float>(r,c))
+			range.at<float>(r,c) = s;
+	}
+
+	// Fill gaps between samples with the mean of valid neighbours
+	for(k=0; k < 3; k++) {
+		filled = range.clone();
+		for(i=1; i < RANGE_HEIGHT-1; i++)
+			for(j=1; j < RANGE_WIDTH-1; j++)
+				if(range.at<float>(i,j) <= 0.0f) {
+					for(r=-1, n=0, s=0.0; r <= 1; r++)
+						for(c=-1; c <= 1; c++)
+							if(range.at<float>(i+r,j+c) > 0.0f) {
+								s += range.at<float>(i+r,j+c);
+								n++;
+							}
+					if(n >= 3)
+						filled.at<float>(i,j) = s/n;
+				}
+		range = filled;
+	}
+
+	range.convertTo(filled, CV_16UC1, RANGE_SCALE);
+	filled.setTo(Scalar(MAX_DEPTH_VALUE), filled > MAX_DEPTH_VALUE);
+
+	return filled;
+}
@@ -0,0 +1,12 @@
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+using namespace std;
+
+// 3D face normalization - the face cloud is aligned to a reference model with ICP and resampled
+// to a range image with the nose tip at (MODEL_HEIGHT_1, MODEL_WIDTH). Range images are 16-bit,
+// in tenths of mm above a plane 250 mm behind the nose tip (0 where there is no data).
+// The model is a range image (.pgm) or a distance field built from one with normalization_field (.field).
+int normalization_model(const char *filename);
+int normalization_field(const char *model_file, const char *field_file);
+Mat face_normalization(Mat &depth, Vec4d &face);
@@ -0,0 +1,111 @@
+#include <fstream>
+#include <sstream>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "kinect.hpp"
+#include "detection.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Training samples for an LBP depth cascade, taken from projections of annotated depth frames.
+// Each line of the list is "depth.pgm;x;y[;aX;aY;aZ]": a 16-bit disparity frame, the face centre
+// in depth pixels (empty for frames without faces) and the head pose in degrees.
+int main(int argc, char *argv[]) {
+	int width, height, cx, cy, i, j, l, n, di, dj, aX, aY, aZ, npos = 0, nneg = 0, *buffer;
+	double matrix[3][3], imatrix[3][3], background, x, y, d, X, Y, Z;
+	string line, path, field[5], name;
+	IplImage *p, *m, *q;
+	CvPoint3D64f *xyz;
+	Mat depth, proj;
+
+	if(argc < 3) {
+		cout << "Usage: " << argv[0] << " <list.csv> <output dir>" << endl;
+		return -1;
+	}
+
+	ifstream list(argv[1]);
+	string dir(argv[2]);
+	ofstream positives((dir+"/positives.dat").c_str()), negatives((dir+"/negatives.txt").c_str());
+	if(!list || !positives || !negatives) {
+		cout << "Could not open " << argv[1] << " or write to " << dir << endl;
+		return -1;
+	}
+
+	width = (int)(X_WIDTH*RESOLUTION);
+	height = (int)(X_WIDTH*RESOLUTION);
+	cx = width/2;
+	cy = height/2;
+
+	p = cvCreateImage(cvSize(width, height), IPL_DEPTH_64F, 1);
+	m = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	q = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	xyz = (CvPoint3D64f *) malloc(SIZE*sizeof(CvPoint3D64f));
+	buffer = (int *) malloc(3*width*height*sizeof(int));
+	background = projection_background();
+
+	while(getline(list, line)) {
+		stringstream liness(line);
+		getline(liness, path, ';');
+		for(i=0; i < 5; i++)
+			if(!getline(liness, field[i], ';'))
+				field[i] = "";
+		if(path.empty())
+			continue;
+
+		depth = imread(path, CV_LOAD_IMAGE_ANYDEPTH);
+		if(depth.empty() || depth.type() != CV_16UC1 || depth.rows != HEIGHT || depth.cols != WIDTH) {
+			cerr << path << ": not a " << WIDTH << "x" << HEIGHT << " 16-bit depth frame" << endl;
+			continue;
+		}
+
+		aX = field[2].empty() ? 0 : atoi(field[2].c_str());
+		aY = field[3].empty() ? 0 : atoi(field[3].c_str());
+		aZ = field[4].empty() ? 0 : atoi(field[4].c_str());
+
+		// Same projection and quantization used by the detector
+		computeRotationMatrix(matrix, imatrix, aX*0.017453293, aY*0.017453293, aZ*0.017453293);
+		n = depth_cloud(depth, xyz, DEPTH_THRESHOLD, NULL);
+		compute_projection(p, m, xyz, n, matrix, background, buffer, FACE_HALF_SIZE);
+		cvConvertScale(p, q, LBP_SCALE, -background*LBP_SCALE);
+		proj = cvarrToMat(q);
+
+		if(!field[0].empty() && !field[1].empty()) {
+			x = atof(field[0].c_str());
+			y = atof(field[1].c_str());
+			l = depth.at<uint16_t>(cvRound(y), cvRound(x));
+			if(l >= DEPTH_THRESHOLD) {
+				cerr << path << ": no depth at the face centre" << endl;
+				continue;
+			}
+
+			// Face centre in projection coordinates
+			d = -DEPTH_Z3*tan(l/DEPTH_Z2+DEPTH_Z1)*RESOLUTION;
+			X = -((x-DEPTH_CX)/DEPTH_FX)*d;
+			Y = ((y-DEPTH_CY)/DEPTH_FY)*d;
+			Z = d+DEPTH_Z4;
+			j = cx+cvRound(X*matrix[0][0]+Y*matrix[0][1]+Z*matrix[0][2])-FACE_HALF_SIZE;
+			i = cy-cvRound(X*matrix[1][0]+Y*matrix[1][1]+Z*matrix[1][2])-FACE_HALF_SIZE;
+
+			// Positive windows, with one pixel of jitter
+			for(di=-1; di <= 1; di++)
+				for(dj=-1; dj <= 1; dj++)
+					if(i+di >= 0 && j+dj >= 0 && i+di+FACE_SIZE <= height && j+dj+FACE_SIZE <= width) {
+						name = format("pos%d.pgm", npos++);
+						imwrite(dir+"/"+name, proj(Rect(j+dj, i+di, FACE_SIZE, FACE_SIZE)));
+						positives << name << " 1 0 0 " << FACE_SIZE << " " << FACE_SIZE << endl;
+					}
+
+			// Hide the head before using the frame as a negative
+			rectangle(proj, Rect(j-FACE_HALF_SIZE, i-FACE_HALF_SIZE, 2*FACE_SIZE, 2*FACE_SIZE), Scalar(0), CV_FILLED);
+		}
+
+		name = format("neg%d.pgm", nneg++);
+		imwrite(dir+"/"+name, proj);
+		negatives << name << endl;
+	}
+
+	cout << npos << " positive and " << nneg << " negative samples written to " << dir << endl;
+
+	return 0;
+}
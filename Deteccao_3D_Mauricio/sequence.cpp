@@ -0,0 +1,113 @@
+#include <fstream>
+#include <sstream>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "kinect.hpp"
+#include "detection.hpp"
+#include "batch.hpp"
+
+using namespace cv;
+using namespace std;
+
+typedef struct {
+	ifstream *list;
+	stringstream *output;
+	vector<string> paths;					// Path of each frame read, by frame number
+} Sequence;
+
+// Next readable frame of the list (the path is the first ';' field of each line)
+static int read_frame(void *data, Mat &depth) {
+	Sequence *s = (Sequence *) data;
+	string line, path;
+
+	while(getline(*s->list, line)) {
+		stringstream liness(line);
+		getline(liness, path, ';');
+		if(path.empty())
+			continue;
+
+		depth = imread(path, CV_LOAD_IMAGE_ANYDEPTH);
+		if(depth.empty() || depth.type() != CV_16UC1 || depth.rows != HEIGHT || depth.cols != WIDTH) {
+			cerr << path << ": not a " << WIDTH << "x" << HEIGHT << " 16-bit depth frame" << endl;
+			continue;
+		}
+		s->paths.push_back(path);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void write_faces(void *data, int frame, vector<Vec4d> &faces) {
+	Sequence *s = (Sequence *) data;
+	int i;
+
+	*s->output << s->paths[frame] << " " << faces.size();
+	for(i=0; i < (int)faces.size(); i++)
+		*s->output << " " << faces[i][0] << " " << faces[i][1] << " " << faces[i][2] << " " << faces[i][3];
+	*s->output << endl;
+}
+
+// Offline detection of a recorded depth sequence with face_detection_batch.
+// The list has one 16-bit disparity frame per line (the path is the first ';' field, so the lists of
+// samples, explorer and synthetic work). Each output line is "frame n x y s count ..." in frame order.
+// workers may be a list (1,4): the sequence is run once per worker count, the throughput of each run
+// is printed and the results of every run must match the first.
+int main(int argc, char *argv[]) {
+	int i, frames, frontal = 0;
+	double t;
+	string value, first;
+	vector<int> workers;
+	Sequence s;
+
+	if(argc < 4) {
+		cout << "Usage: " << argv[0] << " <list.csv> <output.txt> <workers[,workers...]> [frontal] [cascade.xml]" << endl;
+		return -1;
+	}
+
+	stringstream counts(argv[3]);
+	while(getline(counts, value, ','))
+		workers.push_back(max(atoi(value.c_str()), 1));
+	for(i=4; i < argc; i++) {
+		if(!strcmp(argv[i], "frontal"))
+			frontal = 1;
+		else if(strstr(argv[i], ".xml"))
+			detection_cascade(argv[i]);
+		else {
+			cout << "Unknown argument: " << argv[i] << endl;
+			return -1;
+		}
+	}
+
+	ofstream output(argv[2]);
+	if(workers.empty() || !output) {
+		cout << "Could not write to " << argv[2] << endl;
+		return -1;
+	}
+
+	for(i=0; i < (int)workers.size(); i++) {
+		ifstream list(argv[1]);
+		stringstream results;
+		if(!list) {
+			cout << "Could not open " << argv[1] << endl;
+			return -1;
+		}
+		s.list = &list;
+		s.output = &results;
+		s.paths.clear();
+
+		t = (double)getTickCount();
+		frames = face_detection_batch(read_frame, write_faces, &s, workers[i], frontal);
+		t = ((double)getTickCount()-t)/getTickFrequency();
+
+		cout << workers[i] << " workers: " << frames << " frames in " << t << " s (" << frames/t << " frames/s)" << endl;
+		if(!i)
+			first = results.str();
+		else if(results.str() != first)
+			cout << "Results with " << workers[i] << " workers differ from " << workers[0] << " workers" << endl;
+	}
+
+	output << first;
+
+	return 0;
+}
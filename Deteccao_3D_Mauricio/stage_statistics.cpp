@@ -0,0 +1,90 @@
+#include "stage_statistics.hpp"
+
+#define MAX_STAGES 64
+
+static FILE *out = NULL;
+static int frame, windows, masked, exits[MAX_STAGES+1];
+static int64 ticks[MAX_STAGES+1];
+
+int stage_statistics_open(const char *filename) {
+	stage_statistics_close();
+
+	out = fopen(filename, "w");
+	if(!out)
+		return 0;
+
+	frame = windows = masked = 0;
+	memset(exits, 0, sizeof(exits));
+	memset(ticks, 0, sizeof(ticks));
+
+	fprintf(out, "# frame aX aY aZ windows masked survivors[stage] time_us[stage]\n");
+	return 1;
+}
+
+void stage_statistics_close() {
+	if(!out)
+		return;
+
+	fclose(out);
+	out = NULL;
+}
+
+int stage_statistics_active() {
+	return out != NULL;
+}
+
+// Window that passed 'stage' stages
+void stage_statistics_window(int stage, int64 t) {
+	stage = min(stage, MAX_STAGES);
+	windows++;
+	exits[stage]++;
+	ticks[stage] += t;
+}
+
+void stage_statistics_masked() {
+	masked++;
+}
+
+// Write the histogram of the current pose. Stage times are estimated from the mean time of the
+// windows leaving after each stage, since the cascade cannot be stopped at a given stage.
+void stage_statistics_pose(int aX, int aY, int aZ, int stages) {
+	int s, entered;
+	double m, last, cost, tick_us;
+
+	if(!out)
+		return;
+
+	stages = min(stages, MAX_STAGES);
+	fprintf(out, "%d %d %d %d %d %d", frame, aX, aY, aZ, windows, masked);
+	for(s=0, entered=windows; s < stages; s++) {
+		entered -= exits[s];
+		fprintf(out, " %d", entered);
+	}
+
+	tick_us = 1e6/getTickFrequency();
+	for(s=0, entered=windows, last=0.0; s < stages; s++) {
+		// Windows leaving at stage s evaluated stages 0..s (windows passing all evaluated every stage)
+		if(exits[s] || (s == stages-1 && exits[stages])) {
+			m = s == stages-1 ? (double)(ticks[s]+ticks[stages])/(exits[s]+exits[stages]) : (double)ticks[s]/exits[s];
+			cost = max(m-last, 0.0);
+			last = m;
+		}
+		else
+			cost = 0.0;
+		fprintf(out, " %.1f", entered*cost*tick_us);
+		entered -= exits[s];
+	}
+	fprintf(out, "\n");
+
+	windows = masked = 0;
+	memset(exits, 0, sizeof(exits));
+	memset(ticks, 0, sizeof(ticks));
+}
+
+void stage_statistics_frame() {
+	if(!out)
+		return;
+
+	frame++;
+	fflush(out);
+}
@@ -0,0 +1,14 @@
+#include <opencv2/opencv.hpp>
+#include <opencv/cv.h>
+
+using namespace cv;
+using namespace std;
+
+// Per pose cascade statistics, written as one histogram line per pose and frame
+int stage_statistics_open(const char *filename);
+void stage_statistics_close();
+int stage_statistics_active();
+void stage_statistics_window(int stage, int64 ticks);
+void stage_statistics_masked();
+void stage_statistics_pose(int aX, int aY, int aZ, int stages);
+void stage_statistics_frame();
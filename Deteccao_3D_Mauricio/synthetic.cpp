@@ -0,0 +1,223 @@
+#include <fstream>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "kinect.hpp"
+#include "detection.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Kinect v2 depth camera (ideal pinhole, no distortion)
+#define V2_WIDTH 512
+#define V2_HEIGHT 424
+#define V2_FX 365.5
+#define V2_FY 365.5
+#define V2_CX 256.0
+#define V2_CY 212.0
+
+#define PRIMITIVES 4
+#define GRAZING 0.15						// Surfaces seen at a smaller cosine return no depth
+
+// Ellipsoid in camera coordinates (x right, y down, z forward, in mm)
+typedef struct {
+	double c[3], r[3][3], a[3];
+} Ellipsoid;
+
+static void ellipsoid(Ellipsoid *e, double rotation[3][3], const double *origin, double x, double y, double z, double ax, double ay, double az) {
+	int i, j;
+	double p[3] = {x, y, z};
+
+	for(i=0; i < 3; i++) {
+		e->c[i] = origin[i];
+		for(j=0; j < 3; j++) {
+			e->c[i] += rotation[i][j]*p[j];
+			e->r[i][j] = rotation[i][j];
+		}
+	}
+	e->a[0] = ax;
+	e->a[1] = ay;
+	e->a[2] = az;
+}
+
+// Nearest intersection of the ray t*d with the ellipsoid; returns 0 if there is none
+static int intersect(const Ellipsoid *e, const double *d, double *t, double *cosine) {
+	int i;
+	double o[3], v[3], n[3], A = 0.0, B = 0.0, C = -1.0, D, l = 0.0, dn = 0.0, dl = 0.0;
+
+	// Ray in the unit sphere frame of the ellipsoid
+	for(i=0; i < 3; i++) {
+		o[i] = -(e->r[0][i]*e->c[0]+e->r[1][i]*e->c[1]+e->r[2][i]*e->c[2])/e->a[i];
+		v[i] = (e->r[0][i]*d[0]+e->r[1][i]*d[1]+e->r[2][i]*d[2])/e->a[i];
+		A += v[i]*v[i];
+		B += 2.0*o[i]*v[i];
+		C += o[i]*o[i];
+	}
+
+	D = B*B-4.0*A*C;
+	if(D < 0.0)
+		return 0;
+	*t = (-B-sqrt(D))/(2.0*A);
+	if(*t <= 0.0)
+		return 0;
+
+	// Angle between the ray and the surface normal
+	for(i=0; i < 3; i++) {
+		n[i] = (o[i]+*t*v[i])/e->a[i];
+		l += n[i]*n[i];
+		dn += (e->r[0][i]*d[0]+e->r[1][i]*d[1]+e->r[2][i]*d[2])*n[i];
+		dl += d[i]*d[i];
+	}
+	*cosine = fabs(dn)/sqrt(l*dl);
+
+	return 1;
+}
+
+// Head and shoulders; the head is turned so that the detector pose (aX,aY,aZ) makes it frontal
+static void person(Ellipsoid *e, const double *head, int aX, int aY, int aZ) {
+	double matrix[3][3], imatrix[3][3], rotation[3][3], identity[3][3] = {{1,0,0},{0,1,0},{0,0,1}};
+	int i, j;
+
+	// Detector coordinates have y up and z towards the camera
+	computeRotationMatrix(matrix, imatrix, aX*0.017453293, aY*0.017453293, aZ*0.017453293);
+	for(i=0; i < 3; i++)
+		for(j=0; j < 3; j++)
+			rotation[i][j] = (i ? -1 : 1)*(j ? -1 : 1)*imatrix[i][j];
+
+	ellipsoid(&e[0], rotation, head, 0.0, 0.0, 0.0, 75.0, 105.0, 95.0);		// Head
+	ellipsoid(&e[1], rotation, head, 0.0, 10.0, -92.0, 11.0, 22.0, 16.0);		// Nose
+	ellipsoid(&e[2], identity, head, 0.0, 130.0, 10.0, 50.0, 70.0, 50.0);		// Neck
+	ellipsoid(&e[3], identity, head, 0.0, 330.0, 30.0, 210.0, 160.0, 110.0);	// Shoulders
+}
+
+// Depth along the optical axis of each pixel (0 where there is no return)
+static void render(Mat &z, double fx, double fy, double cx, double cy, Ellipsoid *e, int n, double wall, double noise, double holes, RNG &rng) {
+	int i, j, k;
+	double d[3], t, best, cosine, cbest;
+
+	for(i=0; i < z.rows; i++)
+		for(j=0; j < z.cols; j++) {
+			d[0] = (j-cx)/fx;
+			d[1] = (i-cy)/fy;
+			d[2] = 1.0;
+
+			best = wall > 0.0 ? wall : DBL_MAX;
+			cbest = 1.0;
+			for(k=0; k < n; k++)
+				if(intersect(&e[k], d, &t, &cosine) && t < best) {
+					best = t;
+					cbest = cosine;
+				}
+
+			// Axial noise grows with the square of the distance
+			if(best == DBL_MAX || cbest < GRAZING || rng.uniform(0.0, 1.0) < holes)
+				z.at<float>(i,j) = 0.0f;
+			else
+				z.at<float>(i,j) = best+rng.gaussian(noise*best*best/1.0e6);
+		}
+}
+
+// Synthetic head and shoulders depth frames with ground truth.
+// v1 frames are 640x480 11-bit disparity PGMs listed as "depth.pgm;x;y;aX;aY;aZ" (samples and explorer);
+// v2 frames are 512x424 PGMs in mm listed for Detecao_Facial_3D_Offline, with intrinsics.yml.
+int main(int argc, char *argv[]) {
+	int i, j, f, frames, v2, present, aX, aY, aZ, seed = 1;
+	double noise = 1.5, holes = 0.01, wall = 2500.0, empty = 0.1, head[3], fx, fy, cx, cy, d;
+	string dir, name;
+	Ellipsoid e[PRIMITIVES];
+	Mat z, depth;
+
+	if(argc < 4 || (strcmp(argv[1], "v1") && strcmp(argv[1], "v2"))) {
+		cout << "Usage: " << argv[0] << " <v1|v2> <frames> <output dir> [seed=] [noise=] [holes=] [wall=] [empty=]" << endl;
+		cout << "noise: axial noise at 1 m (mm), holes: dropout rate, wall: background distance (mm, 0 for none), empty: rate of frames without a person" << endl;
+		return -1;
+	}
+
+	v2 = !strcmp(argv[1], "v2");
+	frames = atoi(argv[2]);
+	dir = argv[3];
+
+	for(i=4; i < argc; i++) {
+		if(!strncmp(argv[i], "seed=", 5))
+			seed = atoi(argv[i]+5);
+		else if(!strncmp(argv[i], "noise=", 6))
+			noise = atof(argv[i]+6);
+		else if(!strncmp(argv[i], "holes=", 6))
+			holes = atof(argv[i]+6);
+		else if(!strncmp(argv[i], "wall=", 5))
+			wall = atof(argv[i]+5);
+		else if(!strncmp(argv[i], "empty=", 6))
+			empty = atof(argv[i]+6);
+		else {
+			cout << "Unknown argument: " << argv[i] << endl;
+			return -1;
+		}
+	}
+
+	ofstream truth((dir+"/truth.csv").c_str());
+	ofstream list((dir+"/frames.txt").c_str());
+	if(!truth || !list) {
+		cout << "Could not write to " << dir << endl;
+		return -1;
+	}
+
+	if(v2) {
+		fx = V2_FX;
+		fy = V2_FY;
+		cx = V2_CX;
+		cy = V2_CY;
+
+		FileStorage fs(dir+"/intrinsics.yml", FileStorage::WRITE);
+		fs << "fx" << fx << "fy" << fy << "cx" << cx << "cy" << cy;
+		fs << "k1" << 0.0 << "k2" << 0.0 << "p1" << 0.0 << "p2" << 0.0 << "k3" << 0.0;
+		z.create(V2_HEIGHT, V2_WIDTH, CV_32FC1);
+	}
+	else {
+		fx = DEPTH_FX;
+		fy = DEPTH_FY;
+		cx = DEPTH_CX;
+		cy = DEPTH_CY;
+		z.create(HEIGHT, WIDTH, CV_32FC1);
+	}
+	depth.create(z.rows, z.cols, CV_16UC1);
+
+	// Same seed, same sequence
+	RNG rng(seed);
+	for(f=0; f < frames; f++) {
+		head[0] = rng.uniform(-300.0, 300.0);
+		head[1] = rng.uniform(-200.0, 150.0);
+		head[2] = rng.uniform(700.0, 1500.0);
+		aX = rng.uniform(-10, 21);
+		aY = rng.uniform(-30, 31);
+		aZ = rng.uniform(-10, 11);
+		present = rng.uniform(0.0, 1.0) >= empty;
+
+		person(e, head, aX, aY, aZ);
+		render(z, fx, fy, cx, cy, e, present ? PRIMITIVES : 0, wall, noise, holes, rng);
+
+		// v2 stores mm (0 is no return); v1 stores disparity (DEPTH_RANGE-1 is no return)
+		for(i=0; i < z.rows; i++)
+			for(j=0; j < z.cols; j++) {
+				d = z.at<float>(i,j);
+				if(v2)
+					depth.at<uint16_t>(i,j) = saturate_cast<uint16_t>(d);
+				else if(d <= 0.0)
+					depth.at<uint16_t>(i,j) = DEPTH_RANGE-1;
+				else
+					depth.at<uint16_t>(i,j) = min(max(cvRound((atan(d/DEPTH_Z3)-DEPTH_Z1)*DEPTH_Z2), 0), DEPTH_RANGE-2);
+			}
+
+		name = dir+"/"+format("frame%05d.pgm", f);
+		imwrite(name, depth);
+		list << name << endl;
+
+		// The projected head centre lies on the face
+		truth << name;
+		if(present)
+			truth << ";" << fx*head[0]/head[2]+cx << ";" << fy*head[1]/head[2]+cy << ";" << aX << ";" << aY << ";" << aZ;
+		truth << endl;
+	}
+
+	cout << frames << " frames written to " << dir << endl;
+
+	return 0;
+}
@@ -0,0 +1,271 @@
+// Frame sources for the Kinect v2 tools: the live sensor, the shared-memory frame bus fed by
+// Publicar_Quadros, a recording made by Gravar_Video (.rec) or an image list (one image per line,
+// the path is the first ';' separated field).
+// Define FRAME_SOURCE_KINECT before including to enable the live source (needs libfreenect2).
+//
+// Recorded sources replay as fast as possible unless paced, in which case read() waits until the
+// frame is due according to its timestamp. Live IR and recordings yield the same 8-bit IR image.
+//
+// Live frames carry the sensor sequence number and timestamp (so recordings keep them) and the time
+// they reached the host, from which the tools measure their latency. Recordings and image lists
+// reach the host when they are read. clock() tells which clock the sequence numbers and timestamps
+// of a source are on: the sensor one for live frames, the recording's for recordings (the bus
+// passes on the one of its publisher) and the host one for image lists (numbered at 30 fps).
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "Gravacao_Kinect2.hpp"
+#include "Barramento_Quadros.hpp"
+#include "Conversao_IR.hpp"
+#ifdef FRAME_SOURCE_KINECT
+#include "Captura_Kinect2.hpp"
+#endif
+
+#define LIST_FRAME_INTERVAL 33333   // Timestamp step of image lists - in microseconds (30 fps)
+
+struct SourceFrame {
+  cv::Mat image;
+  unsigned int sequence;            // Frame number on the source clock() (gaps are dropped frames)
+  int64 timestamp;                  // On the source clock() - in microseconds
+  int64 acquired;                   // source_clock() when the frame reached the host
+};
+
+// Monotonic clock - in microseconds
+static inline int64 source_clock() {
+  return (int64) (cv::getTickCount()*1000000.0/cv::getTickFrequency());
+}
+
+class FrameSource {
+public:
+  FrameSource() : paced(false), started(false) {}
+  virtual ~FrameSource() {}
+
+  void set_paced(bool enable) { paced = enable; }
+
+  virtual RecordClock clock() const = 0;
+
+  // Next frame; false at the end of the source
+  bool read(SourceFrame &frame) {
+    int64 wait;
+
+    frame.acquired = 0;
+    if(!next(frame))
+      return false;
+    if(paced) {
+      if(!started) {
+        start = source_clock();
+        first = frame.timestamp;
+        started = true;
+      }
+      wait = (frame.timestamp-first)-(source_clock()-start);
+      if(wait > 0)
+        usleep(wait);
+    }
+    if(!frame.acquired)
+      frame.acquired = source_clock();
+    return true;
+  }
+
+protected:
+  // Live sources set frame.acquired, the others leave it to read()
+  virtual bool next(SourceFrame &frame) = 0;
+
+private:
+  bool paced, started;
+  int64 start, first;
+};
+
+class RecordedSource : public FrameSource {
+public:
+  RecordedSource() : i(0) {}
+  bool open(const std::string &path) { return recording.open(path); }
+  RecordClock clock() const { return recording.clock(); }
+
+protected:
+  // The image points into the mapped file
+  bool next(SourceFrame &frame) {
+    if(i >= recording.frames())
+      return false;
+    frame.image = recording.frame(i);
+    frame.sequence = recording.sequence(i);
+    frame.timestamp = recording.timestamp(i);
+    i++;
+    return true;
+  }
+
+private:
+  FrameRecording recording;
+  unsigned int i;
+};
+
+class ImageListSource : public FrameSource {
+public:
+  ImageListSource() : n(0) {}
+  bool open(const std::string &path) {
+    file.open(path.c_str());
+    return file.good();
+  }
+  RecordClock clock() const { return RECORD_CLOCK_HOST; }
+
+protected:
+  // Images are read as they are needed, in grayscale
+  bool next(SourceFrame &frame) {
+    std::string line, path;
+
+    while(getline(file, line)) {
+      std::stringstream liness(line);
+      getline(liness, path, ';');
+      if(path.empty())
+        continue;
+      frame.image = cv::imread(path, 0);
+      if(frame.image.empty())
+        continue;
+      frame.sequence = ++n;
+      frame.timestamp = (int64) n*LIST_FRAME_INTERVAL;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  std::ifstream file;
+  unsigned int n;
+};
+
+// The image points into the bus and stays valid until the next read
+class BusSource : public FrameSource {
+public:
+  bool open(const std::string &name) { return bus.open(name); }
+  RecordClock clock() const { return (RecordClock) bus.clock(); }
+
+protected:
+  bool next(SourceFrame &frame) { return bus.acquire(frame.image, frame.sequence, frame.timestamp, frame.acquired); }
+
+private:
+  FrameBusConsumer bus;
+};
+
+#ifdef FRAME_SOURCE_KINECT
+// One libfreenect2 context for every device of the process (open devices from one thread)
+static inline libfreenect2::Freenect2 &kinect_context() {
+  static libfreenect2::Freenect2 freenect2;
+  return freenect2;
+}
+
+// Serial numbers of the connected devices
+static inline std::vector<std::string> kinect_serials() {
+  std::vector<std::string> serials;
+  int n = kinect_context().enumerateDevices();
+
+  for(int i = 0; i < n; i++)
+    serials.push_back(kinect_context().getDeviceSerialNumber(i));
+  return serials;
+}
+
+class KinectSource : public FrameSource {
+public:
+  KinectSource(IrGain gain = IR_GAIN_FIXED) : dev(0), capture(0), converter(gain) {}
+  ~KinectSource() {
+    if(capture) {
+      capture->stop();
+      std::cout << "frames captured: " << capture->captured() << ", dropped: " << capture->dropped() << std::endl;
+      delete capture;
+    }
+    if(dev)
+      dev->close();
+  }
+
+  // IR (8-bit, as recorded) or depth (float, in mm) of the given device, the default one if serial is empty
+  bool open(const std::string &serial, unsigned int type, CapturePolicy policy = CAPTURE_NEWEST, int slots = CAPTURE_SLOTS) {
+    libfreenect2::Freenect2 &freenect2 = kinect_context();
+
+    if(freenect2.enumerateDevices() == 0)
+      return false;
+    dev = freenect2.openDevice(serial.empty() ? freenect2.getDefaultDeviceSerialNumber() : serial);
+    if(!dev)
+      return false;
+    this->type = type;
+    capture = new KinectCapture(dev, type, policy, slots);
+    capture->start();
+    std::cout << "device serial: " << dev->getSerialNumber() << std::endl;
+    std::cout << "device firmware: " << dev->getFirmwareVersion() << std::endl;
+    return true;
+  }
+
+  libfreenect2::Freenect2Device *device() { return dev; }
+  RecordClock clock() const { return RECORD_CLOCK_SENSOR; }
+
+protected:
+  bool next(SourceFrame &frame) {
+    CaptureFrame *slot = capture->acquire();
+
+    if(!slot)
+      return false;
+    if(type == libfreenect2::Frame::Ir)
+      converter.convert(slot->ir, frame.image);
+    else
+      slot->depth.copyTo(frame.image);
+    frame.sequence = slot->sensor_sequence;
+    frame.timestamp = slot->sensor_timestamp;
+    frame.acquired = (int64) (slot->timestamp*1000000.0/cv::getTickFrequency());
+    capture->release(slot);
+    return true;
+  }
+
+private:
+  libfreenect2::Freenect2Device *dev;
+  KinectCapture *capture;
+  IrConverter converter;
+  unsigned int type;
+};
+#endif
+
+// "kinect[:serial]" (live IR), "kinect-auto[:serial]" (live IR with auto gain),
+// "kinect-depth[:serial]" (live depth), "bus[:name]", a .rec recording or an image list; NULL if
+// the source cannot be opened. every_frame queues live frames instead of keeping only the newest
+// (the bus always gives the newest)
+static inline FrameSource *open_frame_source(const std::string &spec, bool every_frame = false) {
+  size_t colon = spec.find(':');
+
+#ifdef FRAME_SOURCE_KINECT
+  if(spec.compare(0, 6, "kinect") == 0) {
+    KinectSource *source = new KinectSource(spec.compare(0, 11, "kinect-auto") == 0 ? IR_GAIN_AUTO : IR_GAIN_FIXED);
+    bool depth = spec.compare(0, 12, "kinect-depth") == 0;
+    if(!source->open(colon == std::string::npos ? "" : spec.substr(colon+1), depth ? libfreenect2::Frame::Depth : libfreenect2::Frame::Ir,
+                     every_frame ? CAPTURE_QUEUE : CAPTURE_NEWEST, every_frame ? 64 : CAPTURE_SLOTS)) {
+      delete source;
+      return 0;
+    }
+    return source;
+  }
+#endif
+  if(spec.compare(0, 3, "bus") == 0 && (spec.size() == 3 || colon == 3)) {
+    BusSource *source = new BusSource();
+    if(!source->open(colon == std::string::npos ? BUS_NAME : spec.substr(colon+1))) {
+      delete source;
+      return 0;
+    }
+    return source;
+  }
+  if(spec.size() > 4 && spec.compare(spec.size()-4, 4, ".rec") == 0) {
+    RecordedSource *source = new RecordedSource();
+    if(!source->open(spec)) {
+      delete source;
+      return 0;
+    }
+    return source;
+  }
+
+  ImageListSource *source = new ImageListSource();
+  if(!source->open(spec)) {
+    delete source;
+    return 0;
+  }
+  return source;
+}
@@ -0,0 +1,373 @@
+// Kinect v2 frame recordings in a single indexed file
+//
+// FrameRecorder appends frames from a background writer thread into a file that is preallocated in
+// RECORD_CHUNK steps; record() only copies the frame into one of a set of preallocated buffers.
+// Frames are stored raw, with the lossless 16-bit codec (RECORD_LOSSLESS) or as JPEG (RECORD_JPEG);
+// encoding happens on the writer thread.
+// FrameRecording maps a recording read-only and gives random access by frame number (no copies for
+// raw recordings).
+//
+// Layout: RecordingHeader, then per frame a RecordHeader followed by the pixels, then the index
+// (one RecordIndex per frame) written on close. Without an index (interrupted recording) the
+// records are scanned on open.
+//
+// The header says which clock the timestamps are on: the sensor clock for live Kinect frames (with
+// the sensor sequence numbers) or the host clock. KV2REC01 (raw, shorter header) and KV2REC02 files
+// (no clock field) are still read; both hold host arrival times and arrival order.
+
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "Compressao_Profundidade.hpp"
+
+#define RECORD_MAGIC "KV2REC03"
+#define RECORD_MAGIC_HOST "KV2REC02"   // Header without clock, host timestamps
+#define RECORD_MAGIC_RAW "KV2REC01"    // Raw frames, header without codec nor clock, host timestamps
+#define RECORD_CHUNK (64 << 20)     // File preallocation step - in bytes
+#define RECORD_BUFFERS 32           // Frames waiting to be written before record() blocks
+#define RECORD_JPEG_QUALITY 95
+
+enum RecordCodec { RECORD_RAW, RECORD_LOSSLESS, RECORD_JPEG };
+
+// RECORD_CLOCK_SENSOR: libfreenect2 frame timestamps and sequence numbers
+// RECORD_CLOCK_HOST: host arrival time (getTickCount()) and arrival order
+enum RecordClock { RECORD_CLOCK_HOST, RECORD_CLOCK_SENSOR };
+
+struct RecordingHeader {
+  char magic[8];
+  int32_t width, height, type;      // OpenCV type of every frame (decoded)
+  uint32_t frames;                  // Set on close
+  uint64_t index;                   // Offset of the index, 0 until closed
+  int32_t codec;                    // RecordCodec (absent in KV2REC01)
+  int32_t clock;                    // RecordClock of the timestamps (unset before KV2REC03)
+};
+#define RECORD_HEADER_RAW 32        // Size of the KV2REC01 header
+
+struct RecordHeader {
+  uint32_t size;                    // Pixel bytes that follow
+  uint32_t sequence;                // Frame number on the recording clock (gaps are dropped frames)
+  int64_t timestamp;                // On the recording clock - in microseconds
+};
+
+struct RecordIndex {
+  uint64_t offset;                  // Offset of the pixels
+  RecordHeader record;
+};
+
+class FrameRecorder {
+public:
+  FrameRecorder() : fd(-1), running(false) {}
+  ~FrameRecorder() { close(); }
+
+  // clock is the one the sequence numbers and timestamps given to record() come from.
+  // RECORD_LOSSLESS needs CV_16UC1 frames, RECORD_JPEG CV_8UC1 or CV_8UC3
+  bool open(const std::string &path, int width, int height, int type, RecordClock clock, RecordCodec codec = RECORD_RAW, int buffers = RECORD_BUFFERS) {
+    RecordingHeader header;
+
+    if(fd >= 0)
+      return false;
+    if((codec == RECORD_LOSSLESS && type != CV_16UC1) || (codec == RECORD_JPEG && type != CV_8UC1 && type != CV_8UC3))
+      return false;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+      return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORD_MAGIC, 8);
+    header.width = width;
+    header.height = height;
+    header.type = type;
+    header.codec = codec;
+    header.clock = clock;
+    if(pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+      ::close(fd);
+      fd = -1;
+      return false;
+    }
+    end = sizeof(header);
+    allocated = 0;
+    this->codec = codec;
+    format = cv::Size(width, height);
+    type_ = type;
+    jpeg.clear();
+    jpeg.push_back(cv::IMWRITE_JPEG_QUALITY);
+    jpeg.push_back(RECORD_JPEG_QUALITY);
+    failed = false;
+    index.clear();
+
+    queue.resize(std::max(buffers, 1));
+    records.resize(queue.size());
+    for(size_t i = 0; i < queue.size(); i++)
+      queue[i].create(height, width, type);
+    head = tail = 0;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&filled, NULL);
+    pthread_cond_init(&emptied, NULL);
+    running = true;
+    pthread_create(&thread, NULL, &FrameRecorder::run, this);
+    return true;
+  }
+
+  // Queues a copy of the frame; blocks only while every buffer waits to be written.
+  // false (nothing recorded) if the frame is not of the size and type given to open()
+  bool record(const cv::Mat &frame, unsigned int sequence, int64 timestamp) {
+    if(fd < 0 || frame.size() != format || frame.type() != type_)
+      return false;
+
+    pthread_mutex_lock(&mutex);
+    while(tail-head == queue.size())
+      pthread_cond_wait(&emptied, &mutex);
+    pthread_mutex_unlock(&mutex);
+
+    // Only the writer reads the buffer at head, so the one at tail is ours
+    frame.copyTo(queue[tail % queue.size()]);
+    records[tail % queue.size()].sequence = sequence;
+    records[tail % queue.size()].timestamp = timestamp;
+
+    pthread_mutex_lock(&mutex);
+    tail++;
+    pthread_cond_signal(&filled);
+    pthread_mutex_unlock(&mutex);
+    return true;
+  }
+
+  // Writes the pending frames and the index; false if any write failed
+  bool close() {
+    RecordingHeader header;
+    uint64_t size;
+
+    if(fd < 0)
+      return false;
+
+    pthread_mutex_lock(&mutex);
+    running = false;
+    pthread_cond_signal(&filled);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&filled);
+    pthread_cond_destroy(&emptied);
+
+    pread(fd, &header, sizeof(header), 0);
+    header.frames = index.size();
+    header.index = end;
+    size = index.size()*sizeof(RecordIndex);
+    if(size && pwrite(fd, &index[0], size, end) != (ssize_t) size)
+      failed = true;
+    if(pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header))
+      failed = true;
+    if(ftruncate(fd, end+size))
+      failed = true;
+    ::close(fd);
+    fd = -1;
+    queue.clear();
+
+    return !failed;
+  }
+
+  unsigned int frames() const { return index.size(); }
+
+private:
+  static void *run(void *data) {
+    FrameRecorder *recorder = (FrameRecorder *) data;
+    RecordIndex entry;
+    cv::Mat *frame;
+
+    for(;;) {
+      pthread_mutex_lock(&recorder->mutex);
+      while(recorder->head == recorder->tail && recorder->running)
+        pthread_cond_wait(&recorder->filled, &recorder->mutex);
+      if(recorder->head == recorder->tail) {
+        pthread_mutex_unlock(&recorder->mutex);
+        break;
+      }
+      pthread_mutex_unlock(&recorder->mutex);
+
+      frame = &recorder->queue[recorder->head % recorder->queue.size()];
+      entry.record = recorder->records[recorder->head % recorder->queue.size()];
+      entry.offset = recorder->end+sizeof(RecordHeader);
+      if(recorder->codec == RECORD_RAW) {
+        entry.record.size = frame->total()*frame->elemSize();
+        recorder->write(&entry, frame->data);
+      }
+      else {
+        recorder->encoded.clear();
+        if(recorder->codec == RECORD_LOSSLESS)
+          depth_encode(*frame, recorder->encoded);
+        else
+          cv::imencode(".jpg", *frame, recorder->encoded, recorder->jpeg);
+        entry.record.size = recorder->encoded.size();
+        recorder->write(&entry, recorder->encoded.empty() ? 0 : &recorder->encoded[0]);
+      }
+
+      pthread_mutex_lock(&recorder->mutex);
+      recorder->head++;
+      pthread_cond_signal(&recorder->emptied);
+      pthread_mutex_unlock(&recorder->mutex);
+    }
+
+    return NULL;
+  }
+
+  void write(RecordIndex *entry, const void *pixels) {
+    uint64_t size = sizeof(RecordHeader)+entry->record.size;
+
+    if(failed)
+      return;
+    // Grow in large steps so the file stays contiguous and appends never wait on allocation
+    while(end+size > allocated) {
+      if(posix_fallocate(fd, allocated, RECORD_CHUNK)) {
+        failed = true;
+        return;
+      }
+      allocated += RECORD_CHUNK;
+    }
+    if(pwrite(fd, &entry->record, sizeof(RecordHeader), end) != (ssize_t) sizeof(RecordHeader) ||
+       pwrite(fd, pixels, entry->record.size, entry->offset) != (ssize_t) entry->record.size) {
+      failed = true;
+      return;
+    }
+    end += size;
+    index.push_back(*entry);
+  }
+
+  int fd;
+  bool running, failed;
+  RecordCodec codec;
+  cv::Size format;                  // Of every frame, as in the header
+  int type_;
+  std::vector<uchar> encoded;       // Frame being written, when compressed
+  std::vector<int> jpeg;            // imencode parameters
+  uint64_t end, allocated;
+  std::vector<RecordIndex> index;
+  std::vector<cv::Mat> queue;
+  std::vector<RecordHeader> records;
+  size_t head, tail;                // Frames written and queued
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t filled, emptied;
+};
+
+class FrameRecording {
+public:
+  FrameRecording() : data(0), size(0), index(0), count(0) {}
+  ~FrameRecording() { close(); }
+
+  bool open(const std::string &path) {
+    struct stat st;
+    int fd;
+
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      return false;
+    if(fstat(fd, &st) || (size_t) st.st_size < sizeof(RecordingHeader)) {
+      ::close(fd);
+      return false;
+    }
+    data = (uchar *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+      data = 0;
+      return false;
+    }
+    size = st.st_size;
+
+    header = (const RecordingHeader *) data;
+    if(!memcmp(header->magic, RECORD_MAGIC_RAW, 8)) {
+      codec = RECORD_RAW;
+      clock_ = RECORD_CLOCK_HOST;
+      first = RECORD_HEADER_RAW;
+    }
+    else if(size >= sizeof(RecordingHeader) && (!memcmp(header->magic, RECORD_MAGIC, 8) || !memcmp(header->magic, RECORD_MAGIC_HOST, 8))) {
+      codec = (RecordCodec) header->codec;
+      clock_ = memcmp(header->magic, RECORD_MAGIC, 8) ? RECORD_CLOCK_HOST : (RecordClock) header->clock;
+      first = sizeof(RecordingHeader);
+    }
+    else {
+      close();
+      return false;
+    }
+
+    if(header->index && header->index+(uint64_t) header->frames*sizeof(RecordIndex) <= size) {
+      index = (const RecordIndex *) (data+header->index);
+      count = header->frames;
+    }
+    else
+      scan();
+
+    return true;
+  }
+
+  void close() {
+    if(data)
+      munmap(data, size);
+    data = 0;
+    index = 0;
+    count = 0;
+    scanned.clear();
+  }
+
+  unsigned int frames() const { return count; }
+  int width() const { return header->width; }
+  int height() const { return header->height; }
+  int type() const { return header->type; }
+  RecordClock clock() const { return clock_; }
+
+  // Read-only view of frame i in the mapping; compressed frames are decoded into a buffer that is
+  // reused by the next call (empty Mat if the frame is corrupt)
+  cv::Mat frame(unsigned int i) {
+    const uchar *pixels = data+index[i].offset;
+
+    if(codec == RECORD_RAW)
+      return cv::Mat(header->height, header->width, header->type, (void *) pixels);
+    if(codec == RECORD_LOSSLESS) {
+      decoded.create(header->height, header->width, header->type);
+      if(!depth_decode(pixels, index[i].record.size, decoded))
+        return cv::Mat();
+      return decoded;
+    }
+    cv::imdecode(cv::Mat(1, index[i].record.size, CV_8UC1, (void *) pixels), header->type == CV_8UC1 ? 0 : 1).copyTo(decoded);
+    return decoded;
+  }
+  unsigned int sequence(unsigned int i) const { return index[i].record.sequence; }
+  int64 timestamp(unsigned int i) const { return index[i].record.timestamp; }
+
+private:
+  // Index of an interrupted recording - records up to the first incomplete one
+  void scan() {
+    RecordIndex entry;
+    uint64_t offset = first;
+
+    while(offset+sizeof(RecordHeader) <= size) {
+      memcpy(&entry.record, data+offset, sizeof(RecordHeader));
+      if(!entry.record.size || (codec == RECORD_RAW && entry.record.size != (uint64_t) header->width*header->height*CV_ELEM_SIZE(header->type)) ||
+         offset+sizeof(RecordHeader)+entry.record.size > size)
+        break;
+      entry.offset = offset+sizeof(RecordHeader);
+      scanned.push_back(entry);
+      offset = entry.offset+entry.record.size;
+    }
+    index = scanned.empty() ? 0 : &scanned[0];
+    count = scanned.size();
+  }
+
+  uchar *data;
+  uint64_t size, first;             // First record
+  const RecordingHeader *header;
+  RecordCodec codec;
+  RecordClock clock_;
+  cv::Mat decoded;
+  const RecordIndex *index;
+  unsigned int count;
+  std::vector<RecordIndex> scanned;
+};
@@ -0,0 +1,102 @@
+// Latency accounting of a frame pipeline, from the frame reaching the host to the decision
+//
+// begin() takes each frame as the pipeline gets it: it counts the sensor sequence numbers that
+// never arrived (lost by the sensor, the driver, the capture ring or the bus) and measures how long
+// the frame waited since it reached the host (queue) and, for frames with sensor timestamps, its
+// sensor delay. The sensor and host clocks differ by an unknown constant, so the sensor delay is
+// host arrival minus sensor timestamp above the smallest seen - the transfer time beyond the
+// fastest frame. Stages add their durations and end() gives the end-to-end time. Percentiles are
+// over the last LATENCY_WINDOW samples of each stage.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#define LATENCY_WINDOW 4096         // Samples kept per stage
+
+enum { LATENCY_SENSOR, LATENCY_QUEUE, LATENCY_TOTAL };
+
+class LatencyStats {
+public:
+  LatencyStats() : frames_(0), lost_(0), last(0), sensed(0), offset(0), acquired(0) {
+    stage("sensor");
+    stage("queue");
+    stage("end-to-end");
+  }
+
+  // Index of a new stage, reported in the order added (end-to-end last)
+  int stage(const std::string &name) {
+    Stage s;
+    s.name = name;
+    s.count = 0;
+    s.samples.resize(LATENCY_WINDOW);
+    stages.push_back(s);
+    return stages.size()-1;
+  }
+
+  // All times in microseconds, now on the clock of acquired (source_clock()). sensor tells whether
+  // timestamp is on the sensor clock; other timestamps give no sensor delay
+  void begin(unsigned int sequence, int64 timestamp, int64 acquired, int64 now, bool sensor) {
+    int64 delay = acquired-timestamp;
+
+    if(frames_ && sequence > last+1)
+      lost_ += sequence-last-1;
+    last = sequence;
+    frames_++;
+    this->acquired = acquired;
+    if(sensor) {
+      if(!sensed++ || delay < offset)
+        offset = delay;
+      add(LATENCY_SENSOR, delay-offset);
+    }
+    add(LATENCY_QUEUE, now-acquired);
+  }
+
+  void add(int stage, int64 us) {
+    Stage &s = stages[stage];
+    s.samples[s.count++ % LATENCY_WINDOW] = us/1000.0f;
+  }
+
+  // End-to-end time of the current frame - in microseconds
+  int64 end(int64 now) {
+    add(LATENCY_TOTAL, now-acquired);
+    return now-acquired;
+  }
+
+  void report(std::ostream &out) const {
+    out << "  frames: " << frames_ << ", sequence numbers lost: " << lost_ << std::endl;
+    for(size_t i = 0; i < stages.size(); i++)
+      if(i != LATENCY_TOTAL)
+        report(out, stages[i]);
+    report(out, stages[LATENCY_TOTAL]);
+  }
+
+  unsigned int frames() const { return frames_; }
+  unsigned int lost() const { return lost_; }
+
+private:
+  struct Stage {
+    std::string name;
+    std::vector<float> samples;     // Ring of the last LATENCY_WINDOW, in ms
+    unsigned long count;
+  };
+
+  static void report(std::ostream &out, const Stage &s) {
+    if(!s.count)
+      return;
+    std::vector<float> sorted(s.samples.begin(), s.samples.begin()+std::min(s.count, (unsigned long) LATENCY_WINDOW));
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    out << "  " << s.name << ": p50 " << sorted[n/2] << " ms, p90 " << sorted[n*9/10] << " ms, p99 " << sorted[n*99/100]
+        << " ms, max " << sorted[n-1] << " ms (" << s.count << " samples)" << std::endl;
+  }
+
+  std::vector<Stage> stages;
+  unsigned int frames_, lost_, last;
+  unsigned int sensed;              // Frames with a sensor timestamp
+  int64 offset;                     // Smallest host arrival minus sensor timestamp
+  int64 acquired;                   // Host arrival of the current frame
+};
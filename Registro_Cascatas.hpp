@@ -0,0 +1,48 @@
+// Cascade classifiers loaded once and kept for every call that needs them
+//
+// cascade(path) gives the calling thread its classifier of the file, parsing it only the first time
+// the thread asks. OpenCV classifiers keep evaluation state while detecting and copies share it, so
+// a classifier cannot serve two threads: each thread has its own, freed when the thread exits.
+
+#include <map>
+#include <string>
+#include <pthread.h>
+
+#include <opencv2/objdetect/objdetect.hpp>
+
+typedef std::map<std::string, cv::CascadeClassifier *> CascadeSet;
+
+static pthread_key_t cascade_key;
+static pthread_once_t cascade_once = PTHREAD_ONCE_INIT;
+
+static void cascade_set_free(void *data) {
+  CascadeSet *set = (CascadeSet *) data;
+
+  for(CascadeSet::iterator i = set->begin(); i != set->end(); ++i)
+    delete i->second;
+  delete set;
+}
+
+static void cascade_key_create() {
+  pthread_key_create(&cascade_key, cascade_set_free);
+}
+
+// Empty (as CascadeClassifier::load leaves it) if the file cannot be read; not retried
+static inline cv::CascadeClassifier &cascade(const std::string &path) {
+  CascadeSet *set;
+
+  pthread_once(&cascade_once, cascade_key_create);
+  set = (CascadeSet *) pthread_getspecific(cascade_key);
+  if(!set) {
+    set = new CascadeSet();
+    pthread_setspecific(cascade_key, set);
+  }
+
+  CascadeSet::iterator i = set->find(path);
+  if(i != set->end())
+    return *i->second;
+  cv::CascadeClassifier *classifier = new cv::CascadeClassifier();
+  classifier->load(path);
+  (*set)[path] = classifier;
+  return *classifier;
+}